@@ -0,0 +1,76 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/client/allocator.hpp"
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+using namespace voxfield;
+using namespace voxfield::client;
+
+#define ALLOCATOR_HEAP_SIZE (64 * 1024 * 1024)
+#define ALLOCATOR_CHUNK_COUNT 1024
+#define ALLOCATOR_CHURN_COUNT 1000000
+
+// Simulates streaming chunk meshes in and out of the single vertex heap page.
+static void benchmarkChurn(const char* name, uint32 minSize, uint32 maxSize)
+{
+	OffsetAllocator allocator(ALLOCATOR_HEAP_SIZE);
+	vector<OffsetAllocator::Allocation> allocations(ALLOCATOR_CHUNK_COUNT);
+	mt19937 random(1);
+	uniform_int_distribution<uint32> sizeDistribution(minSize, maxSize);
+	uniform_int_distribution<uint32> chunkDistribution(0, ALLOCATOR_CHUNK_COUNT - 1);
+
+	for (auto& allocation : allocations)
+		allocation = allocator.allocate(sizeDistribution(random));
+
+	uint32 failCount = 0;
+	auto startTime = chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < ALLOCATOR_CHURN_COUNT; i++)
+	{
+		auto& allocation = allocations[chunkDistribution(random)];
+		if (allocation.isValid()) allocator.free(allocation);
+		allocation = allocator.allocate(sizeDistribution(random));
+		if (!allocation.isValid()) failCount++;
+	}
+	auto endTime = chrono::high_resolution_clock::now();
+	auto time = chrono::duration<double, nano>(endTime - startTime).count();
+
+	auto stats = allocator.getStats();
+	printf("%-8s used: %8llu, free regions: %5u, largest free: %8u, "
+		"fragmentation: %.3f, fails: %5u, time: %6.2f ns\n", name,
+		(unsigned long long)(stats.totalSize - stats.freeSize), stats.freeRegionCount,
+		stats.largestFreeRegion, stats.getFragmentation(), failCount, time / ALLOCATOR_CHURN_COUNT);
+
+	// All regions should be merged back after freeing everything.
+	for (auto& allocation : allocations)
+	{
+		if (allocation.isValid()) allocator.free(allocation);
+	}
+	stats = allocator.getStats();
+	if (stats.freeRegionCount != 1 || stats.freeSize != ALLOCATOR_HEAP_SIZE)
+		printf("%-8s error: heap is not coalesced after free\n", name);
+}
+
+void benchmarkAllocator()
+{
+	benchmarkChurn("small", 64, 4096);
+	benchmarkChurn("mixed", 64, 64 * 1024);
+	benchmarkChurn("large", 16 * 1024, 64 * 1024);
+}
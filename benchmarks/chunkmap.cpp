@@ -0,0 +1,105 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/structure.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+
+using namespace voxfield;
+
+#define CHUNK_MAP_LOOKUP_COUNT 1000000
+
+// Returns chunk positions of the cube around origin, in the world chunk loading order.
+static vector<int3> getChunkPositions(uint32 count)
+{
+	auto radius = (int32)ceil(cbrt((double)count) * 0.5);
+	vector<int3> positions;
+	positions.reserve(count);
+	for (int32 z = -radius; z <= radius && positions.size() < count; z++)
+	{
+		for (int32 y = -radius; y <= radius && positions.size() < count; y++)
+		{
+			for (int32 x = -radius; x <= radius && positions.size() < count; x++)
+				positions.push_back(int3(x, y, z));
+		}
+	}
+	return positions;
+}
+
+// Map and ChunkMap share find/emplace/erase surface, so the same code measures both.
+template<class T>
+static void benchmarkMap(const char* name, const vector<int3>& positions)
+{
+	static const int3 sideOffsets[6] =
+	{
+		int3(-1, 0, 0), int3(1, 0, 0), int3(0, -1, 0),
+		int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1),
+	};
+
+	T chunks;
+	auto chunk = (Chunk*)&chunks; // Only compared, never dereferenced.
+	auto startTime = chrono::high_resolution_clock::now();
+	for (const auto& position : positions)
+		chunks.emplace(posToChunkHash(position), chunk);
+	auto endTime = chrono::high_resolution_clock::now();
+	auto insertTime = chrono::duration<double, nano>(endTime - startTime).count();
+
+	// Cluster lookups, center chunk with its six neighbours, some of them are missing.
+	mt19937 random(1);
+	uniform_int_distribution<psize> distribution(0, positions.size() - 1);
+	uint32 foundCount = 0;
+	startTime = chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < CHUNK_MAP_LOOKUP_COUNT; i += 7)
+	{
+		auto position = positions[distribution(random)];
+		foundCount += chunks.find(posToChunkHash(position)) != chunks.end();
+		for (uint8 j = 0; j < 6; j++)
+			foundCount += chunks.find(posToChunkHash(position + sideOffsets[j])) != chunks.end();
+	}
+	endTime = chrono::high_resolution_clock::now();
+	auto lookupTime = chrono::duration<double, nano>(endTime - startTime).count();
+
+	// Removes half of the chunks, same as moving view far away.
+	startTime = chrono::high_resolution_clock::now();
+	for (auto i = chunks.begin(); i != chunks.end();)
+	{
+		int3 position; hashToChunkPos(i->first, position);
+		if (position.x < 0) i = chunks.erase(i);
+		else i++;
+	}
+	endTime = chrono::high_resolution_clock::now();
+	auto eraseTime = chrono::duration<double, nano>(endTime - startTime).count();
+
+	printf("%-9s chunks: %6u, insert: %6.2f ns, lookup: %6.2f ns, "
+		"erase: %6.2f ns, found: %u, left: %u\n", name, (uint32)positions.size(),
+		insertTime / positions.size(), lookupTime / CHUNK_MAP_LOOKUP_COUNT,
+		eraseTime / positions.size(), foundCount, (uint32)chunks.size());
+}
+
+void benchmarkChunkMap()
+{
+	for (uint32 count : { 10000u, 100000u })
+	{
+		auto positions = getChunkPositions(count);
+		benchmarkMap<map<uint64, Chunk*>>("map", positions);
+		benchmarkMap<ChunkMap>("chunk map", positions);
+	}
+}
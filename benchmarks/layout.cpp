@@ -0,0 +1,192 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/chunk.hpp"
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <random>
+
+using namespace voxfield;
+
+#define LAYOUT_ITERATION_COUNT 20
+
+struct LinearLayout final
+{
+	static constexpr const char* name = "linear";
+	static psize getIndex(int32 x, int32 y, int32 z) noexcept
+	{
+		return Chunk::posToLinearIndex(x, y, z);
+	}
+};
+struct MortonLayout final
+{
+	static constexpr const char* name = "morton";
+	static psize getIndex(int32 x, int32 y, int32 z) noexcept
+	{
+		return Chunk::posToMortonIndex(x, y, z);
+	}
+};
+
+//----------------------------------------------------------------------------------------
+// Counts opaque voxels of the 3x3x3 neighbourhood, same access pattern as the AO.
+template<class L>
+static uint64 runOcclusion(const Voxel* voxels) noexcept
+{
+	uint64 sum = 0;
+	for (int32 z = 1; z < CHUNK_LENGTH - 1; z++)
+	{
+		for (int32 y = 1; y < CHUNK_LENGTH - 1; y++)
+		{
+			for (int32 x = 1; x < CHUNK_LENGTH - 1; x++)
+			{
+				for (int32 nz = -1; nz <= 1; nz++)
+				{
+					for (int32 ny = -1; ny <= 1; ny++)
+					{
+						for (int32 nx = -1; nx <= 1; nx++)
+							sum += voxels[L::getIndex(x + nx, y + ny, z + nz)] != NULL_VOXEL;
+					}
+				}
+			}
+		}
+	}
+	return sum;
+}
+
+// Spreads light from the chunk top through empty voxels, one level per step.
+template<class L>
+static uint64 runFloodFill(const Voxel* voxels) noexcept
+{
+	static const int3 sideOffsets[6] =
+	{
+		int3(-1, 0, 0), int3(1, 0, 0), int3(0, -1, 0),
+		int3(0, 1, 0), int3(0, 0, -1), int3(0, 0, 1),
+	};
+
+	static uint8 light[CHUNK_SIZE];
+	memset(light, 0, sizeof(light));
+	deque<int3> queue;
+
+	for (int32 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (int32 x = 0; x < CHUNK_LENGTH; x++)
+		{
+			auto index = L::getIndex(x, CHUNK_LENGTH - 1, z);
+			if (voxels[index] != NULL_VOXEL) continue;
+			light[index] = 15;
+			queue.push_back(int3(x, CHUNK_LENGTH - 1, z));
+		}
+	}
+
+	uint64 sum = 0;
+	while (!queue.empty())
+	{
+		auto position = queue.front();
+		queue.pop_front();
+		auto level = light[L::getIndex(position.x, position.y, position.z)];
+		sum += level;
+		if (level <= 1) continue;
+
+		for (uint8 i = 0; i < 6; i++)
+		{
+			auto near = position + sideOffsets[i];
+			if (near.x < 0 || near.y < 0 || near.z < 0 || near.x >= CHUNK_LENGTH ||
+				near.y >= CHUNK_LENGTH || near.z >= CHUNK_LENGTH) continue;
+			auto index = L::getIndex(near.x, near.y, near.z);
+			if (voxels[index] != NULL_VOXEL || light[index] >= level - 1) continue;
+			light[index] = level - 1;
+			queue.push_back(near);
+		}
+	}
+	return sum;
+}
+
+// Counts 2x2x2 blocks with an opaque voxel, same access pattern as the LOD downsample.
+template<class L>
+static uint64 runDownsample(const Voxel* voxels) noexcept
+{
+	uint64 sum = 0;
+	for (int32 z = 0; z < CHUNK_LENGTH; z += 2)
+	{
+		for (int32 y = 0; y < CHUNK_LENGTH; y += 2)
+		{
+			for (int32 x = 0; x < CHUNK_LENGTH; x += 2)
+			{
+				uint32 count = 0;
+				for (int32 i = 0; i < 8; i++)
+					count += voxels[L::getIndex(x + (i & 1), y + ((i >> 1) & 1), z + (i >> 2))] != NULL_VOXEL;
+				sum += count > 0;
+			}
+		}
+	}
+	return sum;
+}
+
+//----------------------------------------------------------------------------------------
+template<class L>
+static void benchmarkKernels(const Voxel* linearVoxels)
+{
+	auto voxels = new Voxel[CHUNK_SIZE];
+	for (int32 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (int32 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			for (int32 x = 0; x < CHUNK_LENGTH; x++)
+				voxels[L::getIndex(x, y, z)] = linearVoxels[Chunk::posToLinearIndex(x, y, z)];
+		}
+	}
+
+	uint64 (*kernels[3])(const Voxel*) = { runOcclusion<L>, runFloodFill<L>, runDownsample<L> };
+	const char* kernelNames[3] = { "occlusion", "flood", "downsample" };
+
+	for (uint8 i = 0; i < 3; i++)
+	{
+		uint64 result = 0;
+		auto startTime = chrono::high_resolution_clock::now();
+		for (uint32 j = 0; j < LAYOUT_ITERATION_COUNT; j++)
+			result += kernels[i](voxels);
+		auto endTime = chrono::high_resolution_clock::now();
+		auto time = chrono::duration<double, micro>(endTime - startTime).count();
+
+		printf("%-8s %-10s result: %10llu, time: %9.2f us\n", L::name, kernelNames[i],
+			(unsigned long long)(result / LAYOUT_ITERATION_COUNT), time / LAYOUT_ITERATION_COUNT);
+	}
+
+	delete[] voxels;
+}
+
+// Both layouts are measured, chunk storage layout is selected at compile time.
+void benchmarkLayout()
+{
+	#if defined(VOXFIELD_CHUNK_MORTON)
+	printf("chunk storage layout: morton\n");
+	#else
+	printf("chunk storage layout: linear\n");
+	#endif
+
+	// Caves like noise, about one third of the voxels are opaque.
+	auto linearVoxels = new Voxel[CHUNK_SIZE];
+	mt19937 random(1);
+	for (psize i = 0; i < CHUNK_SIZE; i++)
+		linearVoxels[i] = random() % 3 == 0 ? 1 : NULL_VOXEL;
+
+	benchmarkKernels<LinearLayout>(linearVoxels);
+	benchmarkKernels<MortonLayout>(linearVoxels);
+	delete[] linearVoxels;
+}
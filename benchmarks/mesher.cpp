@@ -0,0 +1,205 @@
+//--------------------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//--------------------------------------------------------------------------------------------------
+
+#include "voxfield/client/system/mesher.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace voxfield;
+using namespace voxfield::client;
+
+#define BENCHMARK_ITERATION_COUNT 100
+
+// Counts heap allocations made by the measured code, whole executable is affected.
+static atomic<uint64> allocationCount = 0;
+
+void* operator new(size_t size)
+{
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	auto memory = malloc(size ? size : 1);
+	if (!memory) throw bad_alloc();
+	return memory;
+}
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t size) noexcept { free(memory); }
+
+//--------------------------------------------------------------------------------------------------
+static void generateFull(Chunk* chunk)
+{
+	chunk->fill(DEBUG_VOXEL);
+}
+// Same shape as the GeneratorSystem debug sphere.
+static void generateSphere(Chunk* chunk)
+{
+	auto center = int3(CHUNK_HALF_LENGTH);
+	auto maxDist2 = (CHUNK_HALF_LENGTH / 2) * (CHUNK_HALF_LENGTH / 2);
+
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+			{
+				if (distance2(int3(x, y, z), center) < maxDist2)
+					chunk->set(x, y, z, DEBUG_VOXEL);
+			}
+		}
+	}
+}
+// Worst case for the face count, every voxel side is visible and nothing merges.
+static void generateCheckerboard(Chunk* chunk)
+{
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+			{
+				if ((x + y + z) & 1) chunk->set(x, y, z, DEBUG_VOXEL);
+			}
+		}
+	}
+}
+
+static float getValueNoise(int32 x, int32 z) noexcept
+{
+	auto hash = (uint32)x * 0x8DA6B343u ^ (uint32)z * 0xD8163841u;
+	hash = (hash ^ (hash >> 15u)) * 0x2C1B3C6Du;
+	hash ^= hash >> 12u;
+	return (float)(hash & 0xFFFFu) / 65535.0f;
+}
+static float getTerrainNoise(float x, float z) noexcept
+{
+	auto ix = (int32)floor(x), iz = (int32)floor(z);
+	auto fx = x - ix, fz = z - iz;
+	fx = fx * fx * (3.0f - 2.0f * fx); fz = fz * fz * (3.0f - 2.0f * fz);
+	auto n0 = getValueNoise(ix, iz) + (getValueNoise(ix + 1, iz) - getValueNoise(ix, iz)) * fx;
+	auto n1 = getValueNoise(ix, iz + 1) + (getValueNoise(ix + 1, iz + 1) - getValueNoise(ix, iz + 1)) * fx;
+	return n0 + (n1 - n0) * fz;
+}
+// Deterministic two octave value noise height field, with the surface voxels on top.
+static void generateTerrain(Chunk* chunk)
+{
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+		{
+			auto noise = getTerrainNoise(x / 12.0f, z / 12.0f) * 0.75f +
+				getTerrainNoise(x / 4.0f, z / 4.0f) * 0.25f;
+			auto height = (uint8)(4 + noise * (CHUNK_LENGTH - 8));
+			for (uint8 y = 0; y < height; y++)
+				chunk->set(x, y, z, y + 1 == height ? DEBUG_VOXEL : UNKNOWN_VOXEL);
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+static void benchmarkMesher(const char* name, const Cluster& cluster, const Registry& registry)
+{
+	auto sliceCluster = new SliceCluster(cluster);
+	const char* modeNames[(uint8)MeshMode::Count] = { "per-face", "greedy" };
+	vector<ChunkQuad> quads;
+	vector<ChunkVertex> vertices;
+	vector<ChunkFace> faces;
+
+	for (uint8 mode = 0; mode < (uint8)MeshMode::Count; mode++)
+	{
+		auto meshMode = (MeshMode)mode;
+		auto quadCount = MesherSystem::generateQuads(*sliceCluster, registry, meshMode, quads);
+		vertices.resize(quadCount * QUAD_VERTEX_COUNT);
+		faces.resize(quadCount);
+
+		// Buffers are already grown, so only the kernel allocations are counted.
+		auto startAllocationCount = allocationCount.load();
+		auto startTime = chrono::high_resolution_clock::now();
+		for (uint32 i = 0; i < BENCHMARK_ITERATION_COUNT; i++)
+		{
+			MesherSystem::generateQuads(*sliceCluster, registry, meshMode, quads);
+			MesherSystem::writeVertices(quads.data(), quadCount, vertices.data());
+		}
+		auto endTime = chrono::high_resolution_clock::now();
+		auto allocations = allocationCount.load() - startAllocationCount;
+		auto time = chrono::duration<double>(endTime - startTime).count() / BENCHMARK_ITERATION_COUNT;
+
+		startTime = chrono::high_resolution_clock::now();
+		for (uint32 i = 0; i < BENCHMARK_ITERATION_COUNT; i++)
+			MesherSystem::writeFaces(quads.data(), quadCount, faces.data());
+		endTime = chrono::high_resolution_clock::now();
+		auto faceTime = chrono::duration<double>(endTime - startTime).count() / BENCHMARK_ITERATION_COUNT;
+
+		printf("%-8s %-8s faces: %6u, vertex bytes: %8u, face bytes: %7u, "
+			"time: %9.2f us, chunks/s: %9.0f, faces/s: %11.0f, pack: %7.2f us, allocs: %5.2f\n",
+			name, modeNames[mode], quadCount, (uint32)(vertices.size() * sizeof(ChunkVertex)),
+			(uint32)(faces.size() * sizeof(ChunkFace)), time * 1000000.0, 1.0 / time,
+			quadCount / time, faceTime * 1000000.0, (double)allocations / BENCHMARK_ITERATION_COUNT);
+	}
+
+	uint64 hash = 0;
+	auto startTime = chrono::high_resolution_clock::now();
+	for (uint32 i = 0; i < BENCHMARK_ITERATION_COUNT; i++)
+		hash ^= cluster.getContentHash(hashValue(i)).key;
+	auto endTime = chrono::high_resolution_clock::now();
+	auto time = chrono::duration<double, micro>(endTime - startTime).count();
+	printf("%-8s %-8s hash: %016llx, time: %9.2f us\n", name, "cache",
+		(unsigned long long)hash, time / BENCHMARK_ITERATION_COUNT);
+
+	delete sliceCluster;
+}
+
+void benchmarkAllocator();
+void benchmarkChunkMap();
+void benchmarkLayout();
+void benchmarkRegion();
+
+int main(int argc, char *argv[])
+{
+	Registry registry;
+	registry.finalize();
+
+	// Near chunks are empty, so all center chunk border faces are visible.
+	auto chunks = new Chunk[CHUNK_CLUSTER_SIZE];
+	auto cluster = Cluster(&chunks[0], &chunks[1], &chunks[2],
+		&chunks[3], &chunks[4], &chunks[5], &chunks[6]);
+
+	benchmarkMesher("empty", cluster, registry);
+
+	generateFull(&chunks[0]);
+	benchmarkMesher("full", cluster, registry);
+
+	chunks[0].fill(NULL_VOXEL);
+	generateSphere(&chunks[0]);
+	benchmarkMesher("sphere", cluster, registry);
+
+	chunks[0].fill(NULL_VOXEL);
+	generateCheckerboard(&chunks[0]);
+	benchmarkMesher("checker", cluster, registry);
+
+	chunks[0].fill(NULL_VOXEL);
+	generateTerrain(&chunks[0]);
+	benchmarkMesher("terrain", cluster, registry);
+
+	delete[] chunks;
+
+	benchmarkAllocator();
+	benchmarkChunkMap();
+	benchmarkLayout();
+	benchmarkRegion();
+	return 0;
+}
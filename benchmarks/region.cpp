@@ -0,0 +1,100 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/region.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace voxfield;
+
+// 4 region files of the terrain like chunks
+#define REGION_BENCHMARK_LENGTH 16
+
+// Rolling hills, chunks above and below the surface are uniform.
+static void generateRegionChunk(Chunk* chunk)
+{
+	for (int32 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (int32 x = 0; x < CHUNK_LENGTH; x++)
+		{
+			auto worldX = chunk->position.x * CHUNK_LENGTH + x;
+			auto worldZ = chunk->position.z * CHUNK_LENGTH + z;
+			auto height = (int32)(sin(worldX * 0.05f) * 12.0f + cos(worldZ * 0.07f) * 12.0f);
+			auto chunkHeight = std::min(height - chunk->position.y * CHUNK_LENGTH, CHUNK_LENGTH);
+
+			for (int32 y = 0; y < chunkHeight; y++)
+				chunk->set(x, y, z, y + 4 < chunkHeight ? 2 : 1);
+		}
+	}
+	chunk->pack();
+}
+
+void benchmarkRegion()
+{
+	auto directory = fs::temp_directory_path() / "voxfield-bench-region";
+	fs::remove_all(directory);
+
+	vector<Chunk> chunks;
+	for (int32 z = 0; z < REGION_BENCHMARK_LENGTH; z++)
+	{
+		for (int32 y = -2; y < 2; y++)
+		{
+			for (int32 x = 0; x < REGION_BENCHMARK_LENGTH; x++)
+			{
+				Chunk chunk;
+				chunk.position = int3(x, y, z);
+				generateRegionChunk(&chunk);
+				chunks.push_back(std::move(chunk));
+			}
+		}
+	}
+
+	auto storage = new RegionStorage(directory);
+	auto startTime = chrono::high_resolution_clock::now();
+	for (const auto& chunk : chunks) storage->save(chunk);
+	storage->flush();
+	auto endTime = chrono::high_resolution_clock::now();
+	auto writeTime = chrono::duration<double>(endTime - startTime).count();
+	auto stats = storage->getStats();
+	delete storage;
+
+	// New storage maps files from the disk cache, as after the world reload.
+	storage = new RegionStorage(directory);
+	uint32 errorCount = 0;
+	Chunk loadedChunk;
+	startTime = chrono::high_resolution_clock::now();
+	for (const auto& chunk : chunks)
+	{
+		if (!storage->tryLoad(chunk.position, loadedChunk) ||
+			loadedChunk.get(7, 7, 7) != chunk.get(7, 7, 7)) errorCount++;
+	}
+	endTime = chrono::high_resolution_clock::now();
+	auto readTime = chrono::duration<double>(endTime - startTime).count();
+	delete storage;
+
+	psize fileSize = 0;
+	for (const auto& entry : fs::directory_iterator(directory))
+		fileSize += entry.file_size();
+	fs::remove_all(directory);
+
+	printf("region   chunks: %5u, write: %9.0f chunks/s, read: %9.0f chunks/s, "
+		"payload: %6.0f B/chunk, file: %6.0f B/chunk, errors: %u\n", (uint32)chunks.size(),
+		chunks.size() / writeTime, chunks.size() / readTime,
+		(double)stats.writtenBytes / chunks.size(), (double)fileSize / chunks.size(), errorCount);
+}
@@ -18,11 +18,21 @@
 
 #pragma once
 #include "voxfield/voxel.hpp"
+#include "voxfield/job.hpp"
+#include "voxfield/palette.hpp"
+#include "voxfield/slab.hpp"
 #include "garden/defines.hpp"
-#include "voxy/chunk.hpp"
 #include "math/vector.hpp"
 #include "ecsm.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace voxfield
 {
 
@@ -36,6 +46,8 @@ using namespace ecsm;
 #define CHUNK_SIZE 32768
 // CHUNK_LENGTH / 2
 #define CHUNK_HALF_LENGTH 16
+// Up to 8x downsampled meshes
+#define CHUNK_LOD_COUNT 4
 
 static int3 worldToChunkPos(const float3& position) noexcept
 {
@@ -46,35 +58,394 @@ static float3 chunkToWorldPos(const int3& position) noexcept
 	return position * CHUNK_LENGTH;
 }
 
+// Splits world voxel position to the chunk position and voxel position inside it.
+static int3 worldToChunkPos(const int3& position, int3& voxelPosition) noexcept
+{
+	auto chunkPosition = int3(
+		position.x >= 0 ? position.x / CHUNK_LENGTH : (position.x + 1) / CHUNK_LENGTH - 1,
+		position.y >= 0 ? position.y / CHUNK_LENGTH : (position.y + 1) / CHUNK_LENGTH - 1,
+		position.z >= 0 ? position.z / CHUNK_LENGTH : (position.z + 1) / CHUNK_LENGTH - 1);
+	voxelPosition = position - chunkPosition * CHUNK_LENGTH;
+	return chunkPosition;
+}
+
 enum class ChunkState : uint8
 {
 	Allocated, Generating, Generated, Meshing, Meshed, Count
 };
 
+// Chunk voxel slices modified since the last meshing, one bit per slice along each axis.
+struct DirtySlices
+{
+	uint32 x = 0, y = 0, z = 0;
+
+	bool isDirty() const noexcept { return (x | y | z) != 0; }
+	void add(int32 x, int32 y, int32 z) noexcept
+	{
+		this->x |= 1u << x; this->y |= 1u << y; this->z |= 1u << z;
+	}
+	// Returns true if any modified slice lies on the chunk side. (NX, PX, NY, PY, NZ, PZ)
+	bool isSideDirty(uint8 side) const noexcept
+	{
+		auto mask = side & 1u ? 1u << (CHUNK_LENGTH - 1) : 1u;
+		switch (side >> 1u)
+		{
+		case 0: return x & mask;
+		case 1: return y & mask;
+		default: return z & mask;
+		}
+	}
+};
+
 //----------------------------------------------------------------------------------------
-struct Chunk : public Chunk3<CHUNK_LENGTH, CHUNK_LENGTH, CHUNK_LENGTH, Voxel>
+// Chunk without voxel storage is uniform, all its voxels are the same.
+// Storage is allocated on the first different voxel write. Resident chunks can
+// be packed to the palette storage, it is decoded back to the flat array on demand.
+// Packed storage is shared copy-on-write, so copy of a packed chunk is a cheap
+// immutable snapshot for the workers, and the writer clones it only while it is pinned.
+struct Chunk
 {
 protected:
+	Voxel* voxels = nullptr;
+	shared_ptr<PaletteStorage> packedVoxels;
 	uint32 structureID = 0;
 	ID<Entity> entity = {};
+	Voxel uniformVoxel = NULL_VOXEL;
 public:
 	int3 position = int3(0);
+	DirtySlices dirtySlices = {};
 	ChunkState state = ChunkState::Allocated;
+	// Mesh level of detail, voxels are meshed as 2 ^ lod blocks.
+	uint8 lod = 0;
+	// Sides with a finer near chunk LOD, one bit per side.
+	uint8 lodSeams = 0;
 	bool isEmpty = false;
+	// True if voxels differ from the stored ones, so the chunk is saved on eviction.
+	bool isUnsaved = false;
+	// True if chunk is out of view and kept in the structure eviction cache.
+	bool isInactive = false;
+	// Generation of the chunk background jobs, it is not copied with the chunk.
+	JobCounter jobs = {};
 	
-	Chunk() = default;
+	Chunk(Voxel voxel = NULL_VOXEL) : uniformVoxel(voxel) { }
 	Chunk(Voxel voxel, const int3& position,
-		uint32 structureID, ID<Entity> entity) : Chunk3(voxel)
+		uint32 structureID, ID<Entity> entity) : uniformVoxel(voxel)
 	{
 		this->position = position;
 		this->structureID = structureID;
 		this->entity = entity;
 	}
+	Chunk(const Chunk& chunk) { *this = chunk; }
+	Chunk(Chunk&& chunk) noexcept { *this = std::move(chunk); }
+	~Chunk() { freeVoxels(voxels); }
+
+	Chunk& operator=(const Chunk& chunk)
+	{
+		if (this == &chunk) return *this;
+		structureID = chunk.structureID;
+		entity = chunk.entity;
+		position = chunk.position;
+		dirtySlices = chunk.dirtySlices;
+		state = chunk.state;
+		lod = chunk.lod;
+		lodSeams = chunk.lodSeams;
+		isEmpty = chunk.isEmpty;
+		isUnsaved = chunk.isUnsaved;
+		isInactive = chunk.isInactive;
+		copy(chunk);
+		return *this;
+	}
+	Chunk& operator=(Chunk&& chunk) noexcept
+	{
+		if (this == &chunk) return *this;
+		structureID = chunk.structureID;
+		entity = chunk.entity;
+		position = chunk.position;
+		dirtySlices = chunk.dirtySlices;
+		state = chunk.state;
+		lod = chunk.lod;
+		lodSeams = chunk.lodSeams;
+		isEmpty = chunk.isEmpty;
+		isUnsaved = chunk.isUnsaved;
+		isInactive = chunk.isInactive;
+		uniformVoxel = chunk.uniformVoxel;
+		std::swap(voxels, chunk.voxels);
+		std::swap(packedVoxels, chunk.packedVoxels);
+		return *this;
+	}
 	
+	// Returns flat voxel storage slab, shared by the world, generator and mesher chunks.
+	static SlabAllocator& getVoxelSlab()
+	{
+		static SlabAllocator voxelSlab(CHUNK_SIZE * sizeof(Voxel));
+		return voxelSlab;
+	}
+
 	uint32 getStructureID() const noexcept { return structureID; }
 	ID<Entity> getEntity() const noexcept { return entity; }
+
+	static constexpr psize posToLinearIndex(int32 x, int32 y, int32 z) noexcept
+	{
+		return ((psize)z * CHUNK_LENGTH + y) * CHUNK_LENGTH + x;
+	}
+	// Z-order index, near voxels along all axes are stored close to each other.
+	static psize posToMortonIndex(int32 x, int32 y, int32 z) noexcept
+	{
+		#if defined(__BMI2__)
+		return _pdep_u32(x, 0x1249u) | _pdep_u32(y, 0x2492u) | _pdep_u32(z, 0x4924u);
+		#else
+		return spreadMortonBits(x) | (spreadMortonBits(y) << 1u) | (spreadMortonBits(z) << 2u);
+		#endif
+	}
+	// Returns voxel storage index, layout is selected with the VOXFIELD_CHUNK_MORTON.
+	static psize posToIndex(int32 x, int32 y, int32 z) noexcept
+	{
+		#if defined(VOXFIELD_CHUNK_MORTON)
+		return posToMortonIndex(x, y, z);
+		#else
+		return posToLinearIndex(x, y, z);
+		#endif
+	}
+
+	// Returns x row voxels, copies them to the scratch row if storage is not linear.
+	static const Voxel* getRow(const Voxel* voxels, int32 y, int32 z, Voxel* row) noexcept
+	{
+		GARDEN_ASSERT(voxels);
+		#if defined(VOXFIELD_CHUNK_MORTON)
+		for (int32 x = 0; x < CHUNK_LENGTH; x++)
+			row[x] = voxels[posToIndex(x, y, z)];
+		return row;
+		#else
+		return voxels + posToIndex(0, y, z);
+		#endif
+	}
+	// Converts voxels from the storage order to the linear x-fastest order.
+	static void storageToLinear(const Voxel* voxels, Voxel* linearVoxels) noexcept
+	{
+		GARDEN_ASSERT(voxels);
+		GARDEN_ASSERT(linearVoxels);
+		#if defined(VOXFIELD_CHUNK_MORTON)
+		for (int32 z = 0; z < CHUNK_LENGTH; z++)
+		{
+			for (int32 y = 0; y < CHUNK_LENGTH; y++)
+				getRow(voxels, y, z, linearVoxels + posToLinearIndex(0, y, z));
+		}
+		#else
+		memcpy(linearVoxels, voxels, CHUNK_SIZE * sizeof(Voxel));
+		#endif
+	}
+	// Converts voxels from the linear x-fastest order to the storage order.
+	static void linearToStorage(const Voxel* linearVoxels, Voxel* voxels) noexcept
+	{
+		GARDEN_ASSERT(linearVoxels);
+		GARDEN_ASSERT(voxels);
+		#if defined(VOXFIELD_CHUNK_MORTON)
+		for (int32 z = 0; z < CHUNK_LENGTH; z++)
+		{
+			for (int32 y = 0; y < CHUNK_LENGTH; y++)
+			{
+				auto row = linearVoxels + posToLinearIndex(0, y, z);
+				for (int32 x = 0; x < CHUNK_LENGTH; x++)
+					voxels[posToIndex(x, y, z)] = row[x];
+			}
+		}
+		#else
+		memcpy(voxels, linearVoxels, CHUNK_SIZE * sizeof(Voxel));
+		#endif
+	}
+
+//----------------------------------------------------------------------------------------
+	bool isUniform() const noexcept { return !voxels && !packedVoxels; }
+	bool isPacked() const noexcept { return (bool)packedVoxels; }
+	Voxel getUniformVoxel() const noexcept
+	{
+		GARDEN_ASSERT(isUniform());
+		return uniformVoxel;
+	}
+
+	// Returns flat voxel storage, or null if chunk is uniform or packed.
+	const Voxel* getVoxels() const noexcept { return voxels; }
+	// Returns flat voxel storage, allocates or unpacks it if needed.
+	Voxel* getVoxels()
+	{
+		if (packedVoxels) unpack();
+		else if (!voxels) allocate();
+		return voxels;
+	}
+	// Returns packed voxel storage, or null if chunk is not packed.
+	const PaletteStorage* getPackedVoxels() const noexcept { return packedVoxels.get(); }
+
+	// Returns hash of the decoded voxels, flat and packed storages of the same voxels match.
+	// Edited packed storage is rehashed lazily, so it should be called by the owner thread.
+	VoxelHash getContentHash() const
+	{
+		if (voxels) return hashWords(voxels, CHUNK_SIZE * sizeof(Voxel));
+		if (packedVoxels) return packedVoxels->getContentHash();
+		return hashValue(uniformVoxel | 0x5555555555550000ull);
+	}
+
+	Voxel get(int32 x, int32 y, int32 z) const noexcept
+	{
+		GARDEN_ASSERT(x >= 0 && x < CHUNK_LENGTH);
+		GARDEN_ASSERT(y >= 0 && y < CHUNK_LENGTH);
+		GARDEN_ASSERT(z >= 0 && z < CHUNK_LENGTH);
+		if (voxels) return voxels[posToIndex(x, y, z)];
+		if (packedVoxels) return packedVoxels->get(posToIndex(x, y, z));
+		return uniformVoxel;
+	}
+	void set(int32 x, int32 y, int32 z, Voxel voxel)
+	{
+		GARDEN_ASSERT(x >= 0 && x < CHUNK_LENGTH);
+		GARDEN_ASSERT(y >= 0 && y < CHUNK_LENGTH);
+		GARDEN_ASSERT(z >= 0 && z < CHUNK_LENGTH);
+
+		if (packedVoxels)
+		{
+			// Snapshot readers keep the old storage, this chunk gets own copy.
+			if (packedVoxels.use_count() > 1)
+				packedVoxels = make_shared<PaletteStorage>(*packedVoxels);
+			packedVoxels->set(posToIndex(x, y, z), voxel);
+			return;
+		}
+		if (!voxels)
+		{
+			if (voxel == uniformVoxel) return;
+			allocate();
+		}
+		voxels[posToIndex(x, y, z)] = voxel;
+	}
+	// Sets voxel and marks its slices dirty, returns false if voxel is the same.
+	bool edit(int32 x, int32 y, int32 z, Voxel voxel)
+	{
+		if (get(x, y, z) == voxel) return false;
+		set(x, y, z, voxel);
+		dirtySlices.add(x, y, z);
+		isUnsaved = true;
+		return true;
+	}
+
+	// Makes chunk uniform and releases voxel storage.
+	void fill(Voxel voxel) noexcept
+	{
+		freeVoxels(voxels);
+		voxels = nullptr;
+		packedVoxels.reset();
+		uniformVoxel = voxel;
+	}
+	void copy(const Voxel* voxels)
+	{
+		GARDEN_ASSERT(voxels);
+		packedVoxels.reset();
+		if (!this->voxels) this->voxels = allocateVoxels();
+		memcpy(this->voxels, voxels, CHUNK_SIZE * sizeof(Voxel));
+	}
+	void copy(const Chunk& chunk)
+	{
+		if (chunk.voxels)
+		{
+			copy(chunk.voxels);
+		}
+		else if (chunk.packedVoxels)
+		{
+			freeVoxels(voxels);
+			voxels = nullptr;
+			packedVoxels = chunk.packedVoxels; // Shared until one of the chunks is edited.
+		}
+		else
+		{
+			fill(chunk.uniformVoxel);
+		}
+	}
+
+	// Exchanges voxel storage with the chunk without copying it.
+	void swapVoxels(Chunk& chunk) noexcept
+	{
+		std::swap(voxels, chunk.voxels);
+		std::swap(packedVoxels, chunk.packedVoxels);
+		std::swap(uniformVoxel, chunk.uniformVoxel);
+	}
+
+	// Writes all chunk voxels in the storage order to the scratch buffer, of CHUNK_SIZE voxels.
+	void decode(Voxel* voxels) const noexcept
+	{
+		GARDEN_ASSERT(voxels);
+		if (this->voxels) memcpy(voxels, this->voxels, CHUNK_SIZE * sizeof(Voxel));
+		else if (packedVoxels) packedVoxels->decode(voxels);
+		else std::fill(voxels, voxels + CHUNK_SIZE, uniformVoxel);
+	}
+
+	// Replaces flat storage with the palette storage, makes chunk uniform if possible.
+	void pack()
+	{
+		if (!voxels) return;
+		auto packedVoxels = make_shared<PaletteStorage>(voxels, CHUNK_SIZE);
+		if (packedVoxels->getPaletteSize() == 1)
+		{
+			fill(voxels[0]);
+			return;
+		}
+		if (packedVoxels->getIndexBits() >= sizeof(Voxel) * 8)
+			return; // Packed storage is not smaller than the flat one.
+		freeVoxels(voxels);
+		voxels = nullptr;
+		this->packedVoxels = std::move(packedVoxels);
+	}
+	// Decodes palette storage to the flat storage, used before bulk voxel writes.
+	void unpack()
+	{
+		if (!packedVoxels) return;
+		voxels = allocateVoxels();
+		packedVoxels->decode(voxels);
+		packedVoxels.reset();
+	}
+
+	// Returns resident voxel storage size in bytes, shared packed storage is included.
+	psize getStorageSize() const noexcept
+	{
+		if (voxels) return CHUNK_SIZE * sizeof(Voxel);
+		return packedVoxels ? packedVoxels->getMemorySize() : 0;
+	}
+
+	// Releases voxel storage if all chunk voxels are the same.
+	bool tryMakeUniform() noexcept
+	{
+		if (packedVoxels)
+		{
+			if (packedVoxels->getPaletteSize() > 1) return false;
+			fill(packedVoxels->get(0));
+			return true;
+		}
+		if (!voxels) return true;
+
+		auto voxel = voxels[0];
+		for (psize i = 0; i < CHUNK_SIZE; i += CHUNK_LENGTH * CHUNK_LENGTH)
+		{
+			uint32 difference = 0;
+			for (psize j = 0; j < CHUNK_LENGTH * CHUNK_LENGTH; j++)
+				difference |= voxels[i + j] ^ voxel;
+			if (difference) return false;
+		}
+
+		fill(voxel);
+		return true;
+	}
 private:
-	uint16 _alignment = 0;
+	// Moves 5 coordinate bits to every third index bit.
+	static constexpr uint32 spreadMortonBits(uint32 value) noexcept
+	{
+		value = (value | (value << 8u)) & 0x100Fu;
+		value = (value | (value << 4u)) & 0x10C3u;
+		return (value | (value << 2u)) & 0x1249u;
+	}
+
+	static Voxel* allocateVoxels() { return (Voxel*)getVoxelSlab().allocate(); }
+	static void freeVoxels(Voxel* voxels) noexcept { getVoxelSlab().free(voxels); }
+
+	void allocate()
+	{
+		voxels = allocateVoxels();
+		std::fill(voxels, voxels + CHUNK_SIZE, uniformVoxel);
+	}
 };
 
 } // namespace voxfield
\ No newline at end of file
@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "math/types.hpp"
+#include "garden/defines.hpp"
+
+#include <vector>
+#include <utility>
+#include <stdexcept>
+
+namespace voxfield
+{
+
+using namespace std;
+using namespace math;
+
+struct Chunk;
+
+//----------------------------------------------------------------------------------------
+// Open addressing chunk hash map with the linear probing, keyed by posToChunkHash().
+// Entries are stored densely, so iteration is cache friendly and erase of the current
+// entry moves the last one into its place, iteration can continue from the same iterator.
+class ChunkMap final
+{
+public:
+	using Entry = pair<uint64, Chunk*>;
+	using iterator = Entry*;
+	using const_iterator = const Entry*;
+private:
+	struct Slot final
+	{
+		uint64 key;
+		uint32 index;
+	};
+
+	// Chunk hash uses only 63 bits, so all ones key is never valid.
+	static constexpr uint64 emptyKey = UINT64_MAX;
+	static constexpr psize minCapacity = 64;
+
+	vector<Entry> entries;
+	vector<Slot> slots;
+	psize slotMask = 0;
+	uint8 slotShift = 64;
+
+	// Fibonacci hashing, chunk hash low bits are correlated for near chunks.
+	psize getHome(uint64 key) const noexcept
+	{
+		return (psize)((key * 0x9E3779B97F4A7C15ull) >> slotShift);
+	}
+	psize findSlot(uint64 key) const noexcept
+	{
+		if (slots.empty()) return SIZE_MAX;
+		for (auto i = getHome(key);; i = (i + 1) & slotMask)
+		{
+			auto& slot = slots[i];
+			if (slot.key == key) return i;
+			if (slot.key == emptyKey) return SIZE_MAX;
+		}
+	}
+	void insertSlot(uint64 key, uint32 index) noexcept
+	{
+		auto i = getHome(key);
+		while (slots[i].key != emptyKey) i = (i + 1) & slotMask;
+		slots[i] = { key, index };
+	}
+
+	void rehash(psize capacity)
+	{
+		uint8 bits = 0;
+		while (((psize)1 << bits) < capacity) bits++;
+		slots.assign((psize)1 << bits, { emptyKey, 0 });
+		slotMask = slots.size() - 1;
+		slotShift = 64 - bits;
+
+		for (uint32 i = 0; i < (uint32)entries.size(); i++)
+			insertSlot(entries[i].first, i);
+	}
+public:
+	// Keeps load factor under 0.5, short probe sequences matter more than memory.
+	void reserve(psize count)
+	{
+		if (count * 2 > slots.size())
+			rehash(max(count * 2, minCapacity));
+		entries.reserve(count);
+	}
+	void clear() noexcept
+	{
+		entries.clear();
+		for (auto& slot : slots) slot.key = emptyKey;
+	}
+
+	psize size() const noexcept { return entries.size(); }
+	bool empty() const noexcept { return entries.empty(); }
+	iterator begin() noexcept { return entries.data(); }
+	iterator end() noexcept { return entries.data() + entries.size(); }
+	const_iterator begin() const noexcept { return entries.data(); }
+	const_iterator end() const noexcept { return entries.data() + entries.size(); }
+
+//----------------------------------------------------------------------------------------
+	iterator find(uint64 key) noexcept
+	{
+		auto slot = findSlot(key);
+		return slot == SIZE_MAX ? end() : entries.data() + slots[slot].index;
+	}
+	const_iterator find(uint64 key) const noexcept
+	{
+		auto slot = findSlot(key);
+		return slot == SIZE_MAX ? end() : entries.data() + slots[slot].index;
+	}
+	Chunk* at(uint64 key) const
+	{
+		auto result = find(key);
+		if (result == end()) throw out_of_range("Chunk doesn't exist.");
+		return result->second;
+	}
+
+	// Returns existing entry and false if the key is already added.
+	pair<iterator, bool> emplace(uint64 key, Chunk* chunk)
+	{
+		GARDEN_ASSERT(key != emptyKey);
+		auto slot = findSlot(key);
+		if (slot != SIZE_MAX) return { entries.data() + slots[slot].index, false };
+
+		if ((entries.size() + 1) * 2 > slots.size()) reserve(entries.size() + 1);
+		insertSlot(key, (uint32)entries.size());
+		entries.emplace_back(key, chunk);
+		return { entries.data() + entries.size() - 1, true };
+	}
+
+	// Returns iterator to the entry moved into erased place, or end.
+	iterator erase(iterator position) noexcept
+	{
+		GARDEN_ASSERT(position >= begin() && position < end());
+		auto index = (uint32)(position - entries.data());
+		auto hole = findSlot(position->first);
+		GARDEN_ASSERT(hole != SIZE_MAX);
+
+		// Backward shift deletion, so that probe sequences stay without tombstones.
+		for (auto i = (hole + 1) & slotMask;; i = (i + 1) & slotMask)
+		{
+			auto& slot = slots[i];
+			if (slot.key == emptyKey) break;
+			auto home = getHome(slot.key);
+			if (((i - home) & slotMask) >= ((i - hole) & slotMask))
+			{
+				slots[hole] = slot;
+				hole = i;
+			}
+		}
+		slots[hole].key = emptyKey;
+
+		auto lastIndex = (uint32)entries.size() - 1;
+		if (index != lastIndex)
+		{
+			entries[index] = entries[lastIndex];
+			slots[findSlot(entries[index].first)].index = index;
+		}
+		entries.pop_back();
+		return entries.data() + index;
+	}
+	bool erase(uint64 key) noexcept
+	{
+		auto result = find(key);
+		if (result == end()) return false;
+		erase(result);
+		return true;
+	}
+};
+
+} // namespace voxfield
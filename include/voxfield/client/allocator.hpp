@@ -0,0 +1,310 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "garden/defines.hpp"
+#include "math/types.hpp"
+
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace voxfield::client
+{
+
+using namespace std;
+using namespace math;
+
+#define OFFSET_ALLOC_SUBBIN_BITS 3u
+#define OFFSET_ALLOC_SUBBIN_COUNT 8u // 2 ^ 3
+#define OFFSET_ALLOC_BIN_COUNT 256u // 32 * 8
+
+//----------------------------------------------------------------------------------------
+// Two level segregated fit offset allocator, manages a range of some external memory.
+// Free regions are binned by size (8 sub bins per power of two) and coalesced on free,
+// so allocation and free are O(1) with bounded fragmentation. (Does not require GPU)
+class OffsetAllocator final
+{
+public:
+	static constexpr uint32 invalidIndex = UINT32_MAX;
+
+	struct Allocation
+	{
+		uint32 offset = 0;
+		uint32 node = invalidIndex;
+		bool isValid() const noexcept { return node != invalidIndex; }
+	};
+	struct Stats
+	{
+		uint64 totalSize = 0;
+		uint64 freeSize = 0;
+		uint32 largestFreeRegion = 0;
+		uint32 freeRegionCount = 0;
+		uint32 allocationCount = 0;
+
+		// Returns 0 if all free memory is contiguous, close to 1 if it is scattered.
+		float getFragmentation() const noexcept
+		{
+			return freeSize > 0 ? 1.0f - (float)((double)largestFreeRegion / freeSize) : 0.0f;
+		}
+	};
+private:
+	struct Node
+	{
+		uint32 offset = 0;
+		uint32 size = 0;
+		uint32 binPrev = invalidIndex;
+		uint32 binNext = invalidIndex;
+		uint32 neighborPrev = invalidIndex;
+		uint32 neighborNext = invalidIndex;
+		bool isUsed = false;
+	};
+
+	vector<Node> nodes;
+	vector<uint32> freeNodes;
+	uint32 binHeads[OFFSET_ALLOC_BIN_COUNT];
+	uint8 subBinMasks[OFFSET_ALLOC_BIN_COUNT / OFFSET_ALLOC_SUBBIN_COUNT];
+	uint32 binMask = 0;
+	uint32 size = 0;
+	uint32 freeSize = 0;
+	uint32 allocationCount = 0;
+
+	static uint32 findLastBit(uint32 value) noexcept
+	{
+		GARDEN_ASSERT(value != 0);
+		#if defined(_MSC_VER)
+		unsigned long index; _BitScanReverse(&index, value); return index;
+		#else
+		return 31u - __builtin_clz(value);
+		#endif
+	}
+	static uint32 findFirstBit(uint32 value) noexcept
+	{
+		GARDEN_ASSERT(value != 0);
+		#if defined(_MSC_VER)
+		unsigned long index; _BitScanForward(&index, value); return index;
+		#else
+		return __builtin_ctz(value);
+		#endif
+	}
+
+	// Sizes below the sub bin count are stored exactly, others by 3 bit mantissa.
+	static uint32 getBinIndex(uint32 size) noexcept
+	{
+		if (size < OFFSET_ALLOC_SUBBIN_COUNT) return size;
+		auto highBit = findLastBit(size);
+		auto mantissa = (size >> (highBit - OFFSET_ALLOC_SUBBIN_BITS)) & (OFFSET_ALLOC_SUBBIN_COUNT - 1u);
+		return ((highBit - OFFSET_ALLOC_SUBBIN_BITS + 1u) << OFFSET_ALLOC_SUBBIN_BITS) | mantissa;
+	}
+	// Rounds size up, so that every region in the returned bin fits it.
+	static uint32 getSearchBinIndex(uint32 size) noexcept
+	{
+		if (size < OFFSET_ALLOC_SUBBIN_COUNT) return size;
+		auto highBit = findLastBit(size);
+		auto roundSize = (1ull << (highBit - OFFSET_ALLOC_SUBBIN_BITS)) - 1ull;
+		if (size + roundSize > UINT32_MAX) return OFFSET_ALLOC_BIN_COUNT;
+		return getBinIndex((uint32)(size + roundSize));
+	}
+	uint32 findFreeBin(uint32 binIndex) const noexcept
+	{
+		if (binIndex >= OFFSET_ALLOC_BIN_COUNT) return invalidIndex;
+		auto topIndex = binIndex >> OFFSET_ALLOC_SUBBIN_BITS;
+		auto subMask = subBinMasks[topIndex] & (0xFFu << (binIndex & (OFFSET_ALLOC_SUBBIN_COUNT - 1u)));
+		if (subMask == 0)
+		{
+			auto topMask = topIndex + 1u < 32u ? binMask & (UINT32_MAX << (topIndex + 1u)) : 0u;
+			if (topMask == 0) return invalidIndex;
+			topIndex = findFirstBit(topMask);
+			subMask = subBinMasks[topIndex];
+		}
+		return (topIndex << OFFSET_ALLOC_SUBBIN_BITS) | findFirstBit(subMask);
+	}
+
+	uint32 createNode(uint32 offset, uint32 size)
+	{
+		uint32 index;
+		if (freeNodes.empty())
+		{
+			index = (uint32)nodes.size();
+			nodes.emplace_back();
+		}
+		else
+		{
+			index = freeNodes.back();
+			freeNodes.pop_back();
+			nodes[index] = Node();
+		}
+
+		auto& node = nodes[index];
+		node.offset = offset;
+		node.size = size;
+		return index;
+	}
+	void insertFreeNode(uint32 index) noexcept
+	{
+		auto& node = nodes[index];
+		auto binIndex = getBinIndex(node.size);
+		node.isUsed = false;
+		node.binPrev = invalidIndex;
+		node.binNext = binHeads[binIndex];
+		if (node.binNext != invalidIndex) nodes[node.binNext].binPrev = index;
+		binHeads[binIndex] = index;
+		subBinMasks[binIndex >> OFFSET_ALLOC_SUBBIN_BITS] |= 1u << (binIndex & (OFFSET_ALLOC_SUBBIN_COUNT - 1u));
+		binMask |= 1u << (binIndex >> OFFSET_ALLOC_SUBBIN_BITS);
+		freeSize += node.size;
+	}
+	void removeFreeNode(uint32 index) noexcept
+	{
+		auto& node = nodes[index];
+		GARDEN_ASSERT(!node.isUsed);
+		if (node.binPrev != invalidIndex) nodes[node.binPrev].binNext = node.binNext;
+		if (node.binNext != invalidIndex) nodes[node.binNext].binPrev = node.binPrev;
+
+		auto binIndex = getBinIndex(node.size);
+		if (binHeads[binIndex] == index)
+		{
+			binHeads[binIndex] = node.binNext;
+			if (node.binNext == invalidIndex)
+			{
+				auto topIndex = binIndex >> OFFSET_ALLOC_SUBBIN_BITS;
+				subBinMasks[topIndex] &= ~(1u << (binIndex & (OFFSET_ALLOC_SUBBIN_COUNT - 1u)));
+				if (subBinMasks[topIndex] == 0) binMask &= ~(1u << topIndex);
+			}
+		}
+		freeSize -= node.size;
+	}
+public:
+	OffsetAllocator(uint32 size = 0) { reset(size); }
+
+	// Frees all allocations, previous allocation handles become invalid.
+	void reset(uint32 size)
+	{
+		nodes.clear(); freeNodes.clear();
+		for (uint32 i = 0; i < OFFSET_ALLOC_BIN_COUNT; i++) binHeads[i] = invalidIndex;
+		for (auto& mask : subBinMasks) mask = 0;
+		binMask = 0; freeSize = 0; allocationCount = 0;
+		this->size = size;
+		if (size > 0) insertFreeNode(createNode(0, size));
+	}
+
+	// Returns allocated region, or invalid allocation if there is no fitting free region.
+	Allocation allocate(uint32 size, uint32 alignment = 16)
+	{
+		GARDEN_ASSERT(size > 0);
+		GARDEN_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+		// Regions are kept aligned, so only the size is rounded up.
+		if (size > UINT32_MAX - alignment) return Allocation();
+		size = (size + alignment - 1) & ~(alignment - 1);
+		auto binIndex = findFreeBin(getSearchBinIndex(size));
+		if (binIndex == invalidIndex) return Allocation();
+
+		auto index = binHeads[binIndex];
+		removeFreeNode(index);
+
+		auto& node = nodes[index];
+		auto remainder = node.size - size;
+		if (remainder > 0)
+		{
+			auto offset = node.offset + size;
+			node.size = size;
+			auto splitIndex = createNode(offset, remainder); // Note: may invalidate node.
+			auto& splitNode = nodes[splitIndex];
+			auto& usedNode = nodes[index];
+			splitNode.neighborPrev = index;
+			splitNode.neighborNext = usedNode.neighborNext;
+			if (usedNode.neighborNext != invalidIndex) nodes[usedNode.neighborNext].neighborPrev = splitIndex;
+			usedNode.neighborNext = splitIndex;
+			insertFreeNode(splitIndex);
+		}
+
+		nodes[index].isUsed = true;
+		allocationCount++;
+
+		Allocation allocation;
+		allocation.offset = nodes[index].offset;
+		allocation.node = index;
+		return allocation;
+	}
+	// Frees allocated region, merging it with the free neighbor regions.
+	void free(Allocation allocation)
+	{
+		GARDEN_ASSERT(allocation.isValid() && allocation.node < nodes.size());
+		auto index = allocation.node;
+		GARDEN_ASSERT(nodes[index].isUsed);
+		nodes[index].isUsed = false;
+		allocationCount--;
+
+		auto prevIndex = nodes[index].neighborPrev;
+		if (prevIndex != invalidIndex && !nodes[prevIndex].isUsed)
+		{
+			removeFreeNode(prevIndex);
+			auto& prevNode = nodes[prevIndex];
+			prevNode.size += nodes[index].size;
+			prevNode.neighborNext = nodes[index].neighborNext;
+			if (prevNode.neighborNext != invalidIndex) nodes[prevNode.neighborNext].neighborPrev = prevIndex;
+			freeNodes.push_back(index);
+			index = prevIndex;
+		}
+
+		auto nextIndex = nodes[index].neighborNext;
+		if (nextIndex != invalidIndex && !nodes[nextIndex].isUsed)
+		{
+			removeFreeNode(nextIndex);
+			auto& node = nodes[index];
+			node.size += nodes[nextIndex].size;
+			node.neighborNext = nodes[nextIndex].neighborNext;
+			if (node.neighborNext != invalidIndex) nodes[node.neighborNext].neighborPrev = index;
+			freeNodes.push_back(nextIndex);
+		}
+
+		insertFreeNode(index);
+	}
+
+	uint32 getSize() const noexcept { return size; }
+	uint32 getFreeSize() const noexcept { return freeSize; }
+	uint32 getAllocationCount() const noexcept { return allocationCount; }
+	uint32 getAllocationSize(Allocation allocation) const noexcept
+	{
+		GARDEN_ASSERT(allocation.isValid() && allocation.node < nodes.size());
+		return nodes[allocation.node].size;
+	}
+
+	// Collects fragmentation statistics, iterates over all free regions.
+	Stats getStats() const noexcept
+	{
+		Stats stats;
+		stats.totalSize = size;
+		stats.freeSize = freeSize;
+		stats.allocationCount = allocationCount;
+		for (uint32 i = 0; i < OFFSET_ALLOC_BIN_COUNT; i++)
+		{
+			for (auto index = binHeads[i]; index != invalidIndex; index = nodes[index].binNext)
+			{
+				stats.largestFreeRegion = std::max(stats.largestFreeRegion, nodes[index].size);
+				stats.freeRegionCount++;
+			}
+		}
+		return stats;
+	}
+};
+
+} // namespace voxfield::client
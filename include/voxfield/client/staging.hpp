@@ -0,0 +1,127 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "garden/defines.hpp"
+#include "math/types.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace voxfield::client
+{
+
+using namespace std;
+using namespace math;
+
+//----------------------------------------------------------------------------------------
+// Frame fenced staging memory ring, offsets are suballocated lock-free by the workers.
+// Writers should be wrapped into the beginWrite/endWrite calls, so that the main thread
+// releases only memory which copies were recorded at least frameCount frames ago.
+class StagingRing final
+{
+	atomic<uint64> head;
+	atomic<uint64> tail;
+	// Ring head observed by each writer before its allocation, or UINT64_MAX if idle.
+	unique_ptr<atomic<uint64>[]> writeHeads;
+	vector<uint64> frameHeads;
+	uint64 capacity = 0;
+	uint64 safeHead = 0;
+	uint32 writerCount = 0;
+	uint32 frameIndex = 0;
+public:
+	static constexpr uint64 invalidOffset = UINT64_MAX;
+
+	StagingRing(uint64 capacity = 0, uint32 frameCount = 1, uint32 writerCount = 0) :
+		head(0), tail(0), writeHeads(new atomic<uint64>[writerCount]),
+		frameHeads(frameCount, 0), capacity(capacity), writerCount(writerCount)
+	{
+		GARDEN_ASSERT(frameCount > 0);
+		for (uint32 i = 0; i < writerCount; i++) writeHeads[i].store(UINT64_MAX);
+	}
+	StagingRing& operator=(StagingRing&& ring) noexcept
+	{
+		head = ring.head.load(); tail = ring.tail.load();
+		writeHeads = std::move(ring.writeHeads);
+		frameHeads = std::move(ring.frameHeads);
+		capacity = ring.capacity; safeHead = ring.safeHead;
+		writerCount = ring.writerCount; frameIndex = ring.frameIndex;
+		return *this;
+	}
+
+	uint64 getCapacity() const noexcept { return capacity; }
+	uint64 getUsedSize() const noexcept { return head.load() - tail.load(); }
+	uint32 getWriterCount() const noexcept { return writerCount; }
+
+	// Writer index should be unique among concurrent writers, like the worker thread index.
+	void beginWrite(uint32 writerIndex) noexcept
+	{
+		GARDEN_ASSERT(writerIndex < writerCount);
+		GARDEN_ASSERT(writeHeads[writerIndex].load() == UINT64_MAX);
+		writeHeads[writerIndex].store(head.load());
+	}
+	void endWrite(uint32 writerIndex) noexcept
+	{
+		GARDEN_ASSERT(writerIndex < writerCount);
+		GARDEN_ASSERT(writeHeads[writerIndex].load() != UINT64_MAX);
+		writeHeads[writerIndex].store(UINT64_MAX);
+	}
+
+	// Returns ring offset of the allocated memory, or invalidOffset if the ring is full.
+	uint64 allocate(uint64 size, uint64 alignment = 16) noexcept
+	{
+		GARDEN_ASSERT(size > 0);
+		GARDEN_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+		GARDEN_ASSERT(capacity % alignment == 0);
+		if (size > capacity) return invalidOffset;
+
+		auto current = head.load(memory_order_relaxed);
+		while (true)
+		{
+			// Allocation can't cross the ring end, wrapping to the beginning.
+			auto start = (current + alignment - 1) & ~(alignment - 1);
+			if (start % capacity + size > capacity) start = (start / capacity + 1) * capacity;
+			auto end = start + size;
+			if (end - tail.load(memory_order_acquire) > capacity) return invalidOffset;
+			if (head.compare_exchange_weak(current, end, memory_order_acq_rel)) return start % capacity;
+		}
+	}
+
+	// Should be called by the main thread before collecting written allocations.
+	void beginFrame() noexcept
+	{
+		// Allocations below the oldest in progress write are already published. Writers which
+		// are not observed here allocate after the head load, so above the current head.
+		auto committedHead = head.load();
+		for (uint32 i = 0; i < writerCount; i++)
+			committedHead = std::min(committedHead, writeHeads[i].load());
+		safeHead = std::max(safeHead, committedHead);
+	}
+	// Should be called after copies of the collected allocations are recorded.
+	void endFrame() noexcept
+	{
+		frameHeads[frameIndex] = safeHead;
+		frameIndex = (frameIndex + 1) % (uint32)frameHeads.size();
+		auto frameHead = frameHeads[frameIndex];
+		if (frameHead > tail.load()) tail.store(frameHead, memory_order_release);
+	}
+};
+
+} // namespace voxfield::client
@@ -18,18 +18,35 @@
 
 #pragma once
 #include "voxfield/cluster.hpp"
+#include "voxfield/client/staging.hpp"
+#include "voxfield/client/allocator.hpp"
 #include "garden/system/graphics.hpp"
 
+#include <list>
+#include <unordered_map>
+
 namespace voxfield::client
 {
 
 #define CHUNK_VERT_POS_BITS 14u
 #define CHUNK_VERT_NORM_BITS 3u
-#define CHUNK_VERT_UV_BITS 9u
+#define CHUNK_VERT_UV_BITS 8u
+#define CHUNK_VERT_AO_BITS 2u
 
 #define CHUNK_VERT_POS_MASK 16383u // 2 ^ 14 - 1
 #define CHUNK_VERT_NORM_MASK 7u // 2 ^ 3 - 1
-#define CHUNK_VERT_UV_MASK 511u // 2 ^ 9 - 1
+#define CHUNK_VERT_UV_MASK 255u // 2 ^ 8 - 1
+#define CHUNK_VERT_AO_MASK 3u // 2 ^ 2 - 1
+
+#define CHUNK_FACE_POS_BITS 5u
+#define CHUNK_FACE_NORM_BITS 3u
+#define CHUNK_FACE_SIZE_BITS 5u
+#define CHUNK_FACE_AO_BITS 8u
+
+#define CHUNK_FACE_POS_MASK 31u // 2 ^ 5 - 1
+#define CHUNK_FACE_NORM_MASK 7u // 2 ^ 3 - 1
+#define CHUNK_FACE_SIZE_MASK 31u // 2 ^ 5 - 1
+#define CHUNK_FACE_AO_MASK 255u // 2 ^ 8 - 1
 
 using namespace ecsm;
 using namespace garden;
@@ -45,19 +62,179 @@ class MesherSystem;
 //
 // data.y (32bit) :
 //   position.z (14bit)
-//   texCoords.x (9bit)
-//   texCoords.y (9bit)
+//   texCoords.x (8bit)
+//   texCoords.y (8bit)
+//   occlusion (2bit)
 
 struct ChunkVertex
 {
 	uint32 x, y;
 
 	ChunkVertex() = default;
-	ChunkVertex(uint16 x, uint16 y, uint16 z, uint8 normal)
+	ChunkVertex(uint16 x, uint16 y, uint16 z, uint8 normal, uint8 occlusion = CHUNK_VERT_AO_MASK)
 	{
 		this->x = (x * 511u) | ((y * 511u) << CHUNK_VERT_POS_BITS) | (normal << (CHUNK_VERT_POS_BITS * 2u)); // TODO: 511 is temporal
-		this->y = (z * 511u); // TODO: texCoords
+		this->y = (z * 511u) | ((uint32)occlusion << (CHUNK_VERT_POS_BITS + CHUNK_VERT_UV_BITS * 2u)); // TODO: texCoords
+	}
+};
+
+// Chunk mesh quad before expansion to the vertices.
+// Occlusion is 2 bits per corner in [v][u] order, 3 is not occluded.
+struct ChunkQuad
+{
+	uint8 x, y, z, side, sizeU, sizeV;
+	Voxel voxel;
+	uint8 occlusion;
+};
+
+// Chunk Face Memory Layout (one record per quad, expanded by the vertex shader)
+//
+// data.x (32bit) :
+//   position.x (5bit)
+//   position.y (5bit)
+//   position.z (5bit)
+//   normal.xyz (3bit)
+//   size.u - 1 (5bit)
+//   size.v - 1 (5bit)
+//   _unused (4bit)
+//
+// data.y (32bit) :
+//   occlusion (8bit)
+//   _unused (24bit)
+//
+// Texture coordinates are not stored, same as in the vertex format.
+
+struct ChunkFace
+{
+	uint32 x, y;
+
+	ChunkFace() = default;
+	ChunkFace(const ChunkQuad& quad) noexcept
+	{
+		GARDEN_ASSERT(quad.sizeU > 0 && quad.sizeU <= CHUNK_LENGTH);
+		GARDEN_ASSERT(quad.sizeV > 0 && quad.sizeV <= CHUNK_LENGTH);
+		this->x = quad.x | (quad.y << CHUNK_FACE_POS_BITS) |
+			(quad.z << (CHUNK_FACE_POS_BITS * 2u)) | (quad.side << (CHUNK_FACE_POS_BITS * 3u)) |
+			((quad.sizeU - 1u) << (CHUNK_FACE_POS_BITS * 3u + CHUNK_FACE_NORM_BITS)) |
+			((quad.sizeV - 1u) << (CHUNK_FACE_POS_BITS * 3u + CHUNK_FACE_NORM_BITS + CHUNK_FACE_SIZE_BITS));
+		this->y = quad.occlusion;
+	}
+
+	// Returns face quad, voxel is not stored and set to the NULL_VOXEL.
+	ChunkQuad getQuad() const noexcept
+	{
+		ChunkQuad quad;
+		quad.x = x & CHUNK_FACE_POS_MASK;
+		quad.y = (x >> CHUNK_FACE_POS_BITS) & CHUNK_FACE_POS_MASK;
+		quad.z = (x >> (CHUNK_FACE_POS_BITS * 2u)) & CHUNK_FACE_POS_MASK;
+		quad.side = (x >> (CHUNK_FACE_POS_BITS * 3u)) & CHUNK_FACE_NORM_MASK;
+		quad.sizeU = ((x >> (CHUNK_FACE_POS_BITS * 3u + CHUNK_FACE_NORM_BITS)) & CHUNK_FACE_SIZE_MASK) + 1u;
+		quad.sizeV = ((x >> (CHUNK_FACE_POS_BITS * 3u +
+			CHUNK_FACE_NORM_BITS + CHUNK_FACE_SIZE_BITS)) & CHUNK_FACE_SIZE_MASK) + 1u;
+		quad.voxel = NULL_VOXEL;
+		quad.occlusion = y & CHUNK_FACE_AO_MASK;
+		return quad;
+	}
+};
+
+// Chunk mesh generation mode
+enum class MeshMode : uint8
+{
+	PerFace, Greedy, Count
+};
+// Chunk mesh GPU data format
+enum class MeshFormat : uint8
+{
+	Vertex, Face, Count
+};
+
+//----------------------------------------------------------------------------------------
+// Least recently used chunk mesh quads, keyed by the source chunk content hash.
+// Entries store the check half of the hash, key collisions are treated as misses.
+class MeshCache final
+{
+	struct Entry
+	{
+		VoxelHash hash = {};
+		vector<ChunkQuad> quads;
+	};
+
+	list<Entry> entries;
+	unordered_map<uint64, list<Entry>::iterator> lookup;
+	psize byteSize = 0;
+	psize capacity = 0;
+	uint64 hitCount = 0;
+	uint64 missCount = 0;
+	uint64 collisionCount = 0;
+public:
+	MeshCache(psize capacity = 32 * 1024 * 1024) : capacity(capacity) { }
+
+	// Returns cached mesh quads or null, marks entry as recently used.
+	const vector<ChunkQuad>* tryGet(const VoxelHash& hash)
+	{
+		auto result = lookup.find(hash.key);
+		if (result == lookup.end()) { missCount++; return nullptr; }
+		if (result->second->hash.check != hash.check) { missCount++; collisionCount++; return nullptr; }
+		entries.splice(entries.begin(), entries, result->second);
+		hitCount++;
+		return &result->second->quads;
 	}
+	// Colliding entry with the same key is replaced, the newer content is more likely reused.
+	void add(const VoxelHash& hash, const ChunkQuad* quads, uint32 quadCount)
+	{
+		auto quadsSize = quadCount * sizeof(ChunkQuad);
+		if (capacity == 0 || quadsSize > capacity) return;
+
+		auto result = lookup.find(hash.key);
+		if (result != lookup.end())
+		{
+			if (result->second->hash.check == hash.check) return;
+			byteSize -= result->second->quads.size() * sizeof(ChunkQuad);
+			entries.erase(result->second);
+			lookup.erase(result);
+		}
+
+		entries.push_front(Entry());
+		auto& entry = entries.front();
+		entry.hash = hash;
+		entry.quads.assign(quads, quads + quadCount);
+		lookup.emplace(hash.key, entries.begin());
+		byteSize += quadsSize;
+		evict(capacity);
+	}
+
+	// Removes least recently used entries until cache fits the byte size.
+	void evict(psize maxByteSize)
+	{
+		while (byteSize > maxByteSize && !entries.empty())
+		{
+			auto& entry = entries.back();
+			byteSize -= entry.quads.size() * sizeof(ChunkQuad);
+			lookup.erase(entry.hash.key);
+			entries.pop_back();
+		}
+	}
+	void clear() { evict(0); }
+
+	psize getCapacity() const noexcept { return capacity; }
+	void setCapacity(psize capacity) { this->capacity = capacity; evict(capacity); }
+	psize getByteSize() const noexcept { return byteSize; }
+	psize getEntryCount() const noexcept { return entries.size(); }
+	uint64 getHitCount() const noexcept { return hitCount; }
+	uint64 getMissCount() const noexcept { return missCount; }
+	// Returns count of the key matches rejected by the check hash.
+	uint64 getCollisionCount() const noexcept { return collisionCount; }
+};
+
+// Chunk mesh location inside the mesher vertex heap page.
+struct ChunkAllocation
+{
+	uint32 page = OffsetAllocator::invalidIndex;
+	uint32 offset = 0;
+	uint32 node = OffsetAllocator::invalidIndex;
+	uint32 byteSize = 0;
+
+	bool isValid() const noexcept { return page != OffsetAllocator::invalidIndex; }
 };
 
 //----------------------------------------------------------------------------------------
@@ -66,28 +243,101 @@ class MesherSystem final : public System
 public:
 	struct ChunkMesh final
 	{
-		Buffer vertexBuffer;
-		Buffer stagingBuffer;
+		vector<uint8> data; // Used if staging ring was full.
+		uint64 stagingOffset = StagingRing::invalidOffset;
+		uint32 byteSize = 0;
 		uint32 structureID = 0;
 		int3 position = int3(0);
+		uint32 quadCount = 0;
+		// Quads are grouped by the side, in the side order.
+		uint32 sideQuadCounts[VOXEL_SIDE_COUNT] = {};
+		JobHandle job = {};
 	};
 private:
+	struct HeapPage final
+	{
+		ID<Buffer> buffer = {};
+		OffsetAllocator allocator;
+		vector<Buffer::CopyRegion> copyRegions;
+	};
+
 	ThreadSystem* threadSystem = nullptr;
 	GraphicsSystem* graphicsSystem = nullptr;
 	const Registry* registry = nullptr;
-	vector<vector<ChunkVertex>> buffers;
+	vector<vector<ChunkQuad>> quadBuffers;
 	vector<ChunkMesh> meshes;
+	vector<ChunkMesh> pendingMeshes;
+	vector<ChunkMesh> stagedMeshes;
+	StagingRing stagingRing;
+	ID<Buffer> stagingBuffer = {};
+	uint8* stagingMap = nullptr;
+	vector<HeapPage> heapPages;
+	vector<vector<ChunkAllocation>> freeAllocations;
+	uint32 freeFrameIndex = 0;
+	MeshCache meshCache;
 	ID<Buffer> indexBuffer = {};
 	uint32 indexBufferSize = 0;
+	uint32 pendingCount = 0;
+	uint32 cancelledCount = 0;
 	mutex meshMutex;
+	mutex cacheMutex;
 
 	void initialize() final;
+	void reserveIndexBuffer(uint32 indexCount);
+	ChunkMesh createChunkMesh(const ChunkQuad* quads,
+		uint32 quadCount, uint32 structureID, const int3& position);
+	bool tryStageMesh(ChunkMesh& mesh);
+	void recordHeapCopies(ID<Buffer> srcBuffer);
 	static void generate(const ThreadPool::Task& task);
 	friend class ecsm::Manager;
 public:
-	void generateMesh(const Cluster& cluster);
+	// Full detail chunk mesh mode, per face by default. Greedy mode merges coplanar faces
+	// into larger quads, downsampled LOD chunks are always meshed with it.
+	MeshMode meshMode = MeshMode::PerFace;
+	// Face format requires vertex pulling pipeline, should be set before initialization.
+	MeshFormat meshFormat = MeshFormat::Vertex;
+	// Shared mesh upload memory size, should be set before initialization.
+	uint64 stagingRingSize = 32 * 1024 * 1024;
+	// Chunk vertex heap page buffer size, bigger meshes get a dedicated page.
+	uint32 heapPageSize = 64 * 1024 * 1024;
+
+	// Writes cluster center chunk mesh quads grouped by the side, returns quad count. (Does not require GPU)
+	static uint32 generateQuads(const SliceCluster& cluster,
+		const Registry& registry, MeshMode meshMode, vector<ChunkQuad>& quads);
+	// Expands quads to the chunk vertices, QUAD_VERTEX_COUNT vertices per quad.
+	static void writeVertices(const ChunkQuad* quads,
+		uint32 quadCount, ChunkVertex* vertices) noexcept;
+	// Packs quads to the chunk faces, one face per quad.
+	static void writeFaces(const ChunkQuad* quads, uint32 quadCount, ChunkFace* faces) noexcept;
+
+	// Mesh is dropped if the job is cancelled before it is flushed.
+	void generateMesh(const Cluster& cluster, const JobHandle& job = {});
+	// Generates cluster center chunk mesh on the calling thread, used for voxel edits.
+	void generateMeshNow(const Cluster& cluster, std::function<void(ChunkMesh&, uint32)> onMesh);
 	void flush(std::function<void(ChunkMesh&, uint32)> onMesh);
-	ID<Buffer> getVertexBuffer(ChunkMesh& chunkMesh);
+	// Returns count of the background meshes not flushed yet.
+	uint32 getPendingCount() const noexcept { return pendingCount; }
+
+	// Allocates heap memory for the staged mesh and records its upload.
+	ChunkAllocation allocateMesh(const ChunkMesh& chunkMesh);
+	// Frees chunk allocation after the frames in flight are finished.
+	void freeMesh(ChunkAllocation& allocation);
+
+	ID<Buffer> getHeapBuffer(uint32 page) const noexcept { return heapPages[page].buffer; }
+	uint32 getHeapPageCount() const noexcept { return (uint32)heapPages.size(); }
+	// Returns sum of all heap page allocator statistics.
+	OffsetAllocator::Stats getHeapStats() const noexcept;
+
+	// Returns first vertex index of the allocation, used as a draw vertex offset.
+	uint32 getVertexOffset(const ChunkAllocation& allocation) const noexcept
+	{
+		return meshFormat == MeshFormat::Face ? allocation.offset /
+			(uint32)sizeof(ChunkFace) * QUAD_VERTEX_COUNT : allocation.offset / (uint32)sizeof(ChunkVertex);
+	}
+
+	// Returns mesh cache, cacheMutex should be locked while meshing is in progress.
+	MeshCache& getMeshCache() noexcept { return meshCache; }
+	mutex& getCacheMutex() noexcept { return cacheMutex; }
 	ID<Buffer> getIndexBuffer() const noexcept { return indexBuffer; }
 	uint32 getIndexBufferSize() const noexcept { return indexBufferSize; }
 
@@ -31,8 +31,12 @@ class VoxGeoShadRenderSystem;
 
 struct VoxGeoRenderComponent : public MeshRenderComponent
 {
-	ID<Buffer> vertexBuffer = {};
+	// Mesh location inside the mesher vertex heap.
+	ChunkAllocation allocation = {};
 	uint32 indexCount = 0;
+	// Mesh quad ranges of each side, in the side order.
+	uint32 sideQuadCounts[VOXEL_SIDE_COUNT] = {};
+	int3 chunkPosition = int3(0);
 protected:
 	friend class VoxGeoRenderSystem;
 };
@@ -49,9 +53,12 @@ protected:
 	vector<vector<ID<Buffer>>> instanceBuffers = {};
 	ID<GraphicsPipeline> pipeline = {};
 	ID<DescriptorSet> descriptorSet = {};
+	// Heap page face buffer descriptor sets, used with MeshFormat::Face.
+	vector<ID<DescriptorSet>> faceDescriptorSets;
 	View<GraphicsPipeline> pipelineView = {};
 	InstanceData* instanceMap = nullptr;
 	int2 framebufferSize = int2(0);
+	float3 cameraPosition = float3(0.0f);
 	ID<Buffer> indexBuffer = {};
 	uint32 swapchainIndex = 0;
 	GraphicsPipeline::Index indexBufferType = {};
@@ -74,7 +81,11 @@ protected:
 
 	virtual ID<GraphicsPipeline> createPipeline() = 0;
 	virtual map<string, DescriptorSet::Uniform> getUniforms();
+	ID<DescriptorSet> createFaceDescriptorSet(ID<Buffer> faceBuffer);
 public:
+	// Skips chunk side quad groups facing away from the camera.
+	bool useSideCulling = true;
+
 	ID<GraphicsPipeline> getPipeline();
 };
 
@@ -82,6 +93,7 @@ public:
 struct VoxGeoShadRenderComponent : public VoxGeoRenderComponent
 { friend class VoxGeoShadRenderSystem; };
 
+// Draws only MeshFormat::Vertex meshes, shadows are skipped for the face format.
 class VoxGeoShadRenderSystem : public System, public IRenderSystem, public IMeshRenderSystem
 {
 protected:
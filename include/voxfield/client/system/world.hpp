@@ -29,24 +29,71 @@ namespace voxfield::client
 
 class WorldSystem final : public System
 {
+	// Pending chunk generation or meshing, lower priority is dispatched first.
+	struct ChunkJob final
+	{
+		uint64 priority = 0;
+		Cluster cluster = {};
+		bool operator<(const ChunkJob& job) const noexcept { return priority < job.priority; }
+	};
+
 	GraphicsSystem* graphicsSystem = nullptr;
 	GeneratorSystem* generatorSystem = nullptr;
 	MesherSystem* mesherSystem = nullptr;
 	Registry registry = {};
 	Structure structure = {};
+	unique_ptr<RegionStorage> regionStorage;
 	stack<Chunk*> freeChunks;
+	vector<uint64> remeshChunks;
+	vector<ChunkJob> generateJobs;
+	vector<ChunkJob> meshJobs;
+	uint8 reservedViewRadius = 0;
 
 	void initialize() final;
+	void terminate() final;
 	void update() final;
+	void remeshEditedChunks(std::function<void(MesherSystem::ChunkMesh&, uint32)> onMesh);
+	uint8 getLodSeams(const int3& cameraPosition, const int3& chunkPosition, uint8 lod) const noexcept;
+	uint64 getJobPriority(const float3& cameraPosition,
+		const float3& viewDirection, const int3& chunkPosition) const noexcept;
+	void dispatchChunkJobs();
+	void reserveViewChunks();
 
 	friend class ecsm::Manager;
 public:
 	int32 minBorder = STRUCTURE_POS_MIN;
 	int32 maxBorder = STRUCTURE_POS_MAX;
 	uint8 chunkViewRadius = 8;
+	// Fractions of the view radius where the 2x, 4x and 8x downsampled mesh rings begin.
+	float lodDistances[CHUNK_LOD_COUNT - 1] = { 0.5f, 0.75f, 0.875f };
+	// Half angle of the view cone, chunks inside it are generated and meshed first.
+	float viewConeAngle = radians(70.0f);
+	// Maximum count of generating and of meshing chunks, the rest waits by priority.
+	uint32 maxPendingJobs = 64;
+	// Memory budget of the out of view chunks kept for a fast re-entry, in bytes.
+	psize inactiveChunkBudget = 256 * 1024 * 1024;
+
+	// Returns chunk mesh level of detail for the camera chunk position.
+	uint8 getChunkLOD(const int3& cameraPosition, const int3& chunkPosition) const noexcept
+	{
+		auto distance = (float)distance2(cameraPosition, chunkPosition);
+		uint8 lod = 0;
+		while (lod < CHUNK_LOD_COUNT - 1)
+		{
+			auto lodDistance = lodDistances[lod] * chunkViewRadius;
+			if (distance <= lodDistance * lodDistance) break;
+			lod++;
+		}
+		return lod;
+	}
 
 	const Registry& getRegistry() const noexcept { return registry; }
 	const Structure& getStructure() const noexcept { return structure; }
+	// Edited chunk meshes are updated on the next world update.
+	bool trySetVoxel(const int3& position, Voxel voxel)
+	{
+		return structure.trySetVoxel(position, voxel);
+	}
 	stack<Chunk*>& getFreeChunks() noexcept { return freeChunks; }
 };
 
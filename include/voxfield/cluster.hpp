@@ -24,6 +24,20 @@
 namespace voxfield
 {
 
+// Visible center chunk voxel faces. Side order: -X, +X, -Y, +Y, -Z, +Z.
+// Rows: X sides [x][y] of z bits, Y sides [y][z] of x bits, Z sides [z][y] of x bits.
+struct FaceMasks
+{
+	uint32 sides[VOXEL_SIDE_COUNT][CHUNK_LENGTH][CHUNK_LENGTH];
+};
+
+// Opaque voxel bits padded by the near chunk borders, row [z + 1][y + 1] holds x + 1 bits.
+// Near chunk edge and corner voxels are not available and treated as not opaque.
+struct OcclusionMasks
+{
+	uint64 rows[CHUNK_LENGTH + 2][CHUNK_LENGTH + 2];
+};
+
 struct Cluster : public Cluster3<Chunk, Voxel>
 {
 	Cluster(Chunk* c = nullptr,
@@ -43,106 +57,93 @@ struct Cluster : public Cluster3<Chunk, Voxel>
 			(uint8)pz->state > (uint8)ChunkState::Generating;
 	}
 
-	uint8 getNearMask(int16 x, int16 y, int16 z, const Registry& registry) const noexcept
+	// Returns true if center chunk can not have visible voxel faces.
+	bool isHidden(const Registry& registry) const noexcept
 	{
-		GARDEN_ASSERT(x >= 0 && x < CHUNK_LENGTH);
-		GARDEN_ASSERT(y >= 0 && y < CHUNK_LENGTH);
-		GARDEN_ASSERT(z >= 0 && z < CHUNK_LENGTH);
+		if (!c->isUniform()) return false;
+		auto voxel = c->getUniformVoxel();
+		if (registry.isTransparent(voxel)) return true;
+		if (!registry.isOpaque(voxel)) return false;
 
-		auto voxel = c->get(x, y, z);
-		auto voxelData = &registry.getVoxelData(voxel);
-		if (voxelData->drawMode == VoxelDrawMode::Transparent) return 0;
+		return
+			nx->isUniform() && registry.isOpaque(nx->getUniformVoxel()) &&
+			px->isUniform() && registry.isOpaque(px->getUniformVoxel()) &&
+			ny->isUniform() && registry.isOpaque(ny->getUniformVoxel()) &&
+			py->isUniform() && registry.isOpaque(py->getUniformVoxel()) &&
+			nz->isUniform() && registry.isOpaque(nz->getUniformVoxel()) &&
+			pz->isUniform() && registry.isOpaque(pz->getUniformVoxel());
+	}
 
-		Voxel nearVoxel;
-		const VoxelData* nearVoxelData;
-		uint8 mask = 0;
+	// Returns hash of the center and near chunk voxels, used as the mesh cache key.
+	VoxelHash getContentHash(const VoxelHash& seed = {}) const
+	{
+		auto hash = combineHash(seed, c->getContentHash());
+		hash = combineHash(hash, nx->getContentHash());
+		hash = combineHash(hash, px->getContentHash());
+		hash = combineHash(hash, ny->getContentHash());
+		hash = combineHash(hash, py->getContentHash());
+		hash = combineHash(hash, nz->getContentHash());
+		return combineHash(hash, pz->getContentHash());
+	}
+};
 
-		if (x == 0)
-		{
-			nearVoxel = nx->get(CHUNK_LENGTH - 1, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData);
-			nearVoxel = c->get(1, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 3u;
-		}
-		else if (x == CHUNK_LENGTH - 1)
-		{
-			nearVoxel = c->get(CHUNK_LENGTH - 2, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData);
-			nearVoxel = px->get(0, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 3u;
-		}
-		else
-		{
-			nearVoxel = c->get(x - 1, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData);
-			nearVoxel = c->get(x + 1, y, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 3u;
-		}
+//--------------------------------------------------------------------------------------------------
+// Center chunk copy with the near chunk border voxel slices, enough to mesh it.
+// Slice rows: X sides [z][y], Y sides [z][x], Z sides [y][x].
+struct SliceCluster
+{
+	Chunk c;
+	Voxel nx[CHUNK_LENGTH][CHUNK_LENGTH];
+	Voxel px[CHUNK_LENGTH][CHUNK_LENGTH];
+	Voxel ny[CHUNK_LENGTH][CHUNK_LENGTH];
+	Voxel py[CHUNK_LENGTH][CHUNK_LENGTH];
+	Voxel nz[CHUNK_LENGTH][CHUNK_LENGTH];
+	Voxel pz[CHUNK_LENGTH][CHUNK_LENGTH];
 
-		if (y == 0)
-		{
-			nearVoxel = ny->get(x, CHUNK_LENGTH - 1, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 2u;
-			nearVoxel = c->get(x, 1, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 5u;
-		}
-		else if (y == CHUNK_LENGTH - 1)
-		{
-			nearVoxel = c->get(x, CHUNK_LENGTH - 2, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 2u;
-			nearVoxel = py->get(x, 0, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 5u;
-		}
-		else
+	// Near slices are not filled, they should be written by the downsample.
+	explicit SliceCluster(const Chunk& center) : c(center) { }
+	// Mesher reads flat voxel rows, packed center can be unpacked later by the mesh worker.
+	SliceCluster(const Cluster& cluster, bool unpackCenter = true) : c(*cluster.c)
+	{
+		if (unpackCenter) c.unpack();
+		for (uint8 i = 0; i < CHUNK_LENGTH; i++)
 		{
-			nearVoxel = c->get(x, y - 1, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 2u;
-			nearVoxel = c->get(x, y + 1, z);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 5u;
+			for (uint8 j = 0; j < CHUNK_LENGTH; j++)
+			{
+				nx[i][j] = cluster.nx->get(CHUNK_LENGTH - 1, j, i);
+				px[i][j] = cluster.px->get(0, j, i);
+				ny[i][j] = cluster.ny->get(j, CHUNK_LENGTH - 1, i);
+				py[i][j] = cluster.py->get(j, 0, i);
+				nz[i][j] = cluster.nz->get(j, i, CHUNK_LENGTH - 1);
+				pz[i][j] = cluster.pz->get(j, i, 0);
+			}
 		}
+	}
 
-		if (z == 0)
-		{
-			nearVoxel = nz->get(x, y, CHUNK_LENGTH - 1);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 1u;
-			nearVoxel = c->get(x, y, 1);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 4u;
-		}
-		else if (z == CHUNK_LENGTH - 1)
-		{
-			nearVoxel = c->get(x, y, CHUNK_LENGTH - 2);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 1u;
-			nearVoxel = pz->get(x, y, 0);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 4u;
-		}
-		else
-		{
-			nearVoxel = c->get(x, y, z - 1);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 1u;
-			nearVoxel = c->get(x, y, z + 1);
-			nearVoxelData = &registry.getVoxelData(nearVoxel);
-			mask |= (uint8)voxelData->shouldDraw(*nearVoxelData) << 4u;
-		}
+	// Returns center chunk voxel, or near chunk voxel if position is out of bounds by one.
+	Voxel getNearVoxel(int16 x, int16 y, int16 z) const noexcept
+	{
+		GARDEN_ASSERT(x >= -1 && x <= CHUNK_LENGTH);
+		GARDEN_ASSERT(y >= -1 && y <= CHUNK_LENGTH);
+		GARDEN_ASSERT(z >= -1 && z <= CHUNK_LENGTH);
 
-		return mask;
+		if (x < 0) return nx[z][y];
+		if (x == CHUNK_LENGTH) return px[z][y];
+		if (y < 0) return ny[z][x];
+		if (y == CHUNK_LENGTH) return py[z][x];
+		if (z < 0) return nz[y][x];
+		if (z == CHUNK_LENGTH) return pz[y][x];
+		return c.get(x, y, z);
 	}
+
+	// Replaces voxels with the 2 ^ lod downsampled blocks, keeping chunk resolution.
+	// Block is solid if any of its voxels is not transparent, so surfaces only grow.
+	// Seam sides get empty near slices, their border faces cover cracks to finer LODs.
+	void downsample(const Cluster& cluster, const Registry& registry, uint8 lod, uint8 seamSides);
+
+	// Computes all visible center chunk voxel faces using opacity row bitmasks.
+	void getFaceMasks(const Registry& registry, FaceMasks& faceMasks,
+		OcclusionMasks* occlusionMasks = nullptr) const noexcept;
 };
 
 } // namespace voxfield
\ No newline at end of file
@@ -0,0 +1,88 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "garden/defines.hpp"
+
+namespace voxfield
+{
+
+//----------------------------------------------------------------------------------------
+// 128 bit voxel content hash. Check half is finalized separately from the key half,
+// so caches keyed by the key can verify the entry content with the check.
+struct VoxelHash
+{
+	uint64 key = 0;
+	uint64 check = 0;
+
+	bool operator==(const VoxelHash& other) const noexcept
+	{
+		return key == other.key && check == other.check;
+	}
+	bool operator!=(const VoxelHash& other) const noexcept { return !(*this == other); }
+};
+
+// SplitMix64 finalizer.
+static inline uint64 mixHash(uint64 hash) noexcept
+{
+	hash ^= hash >> 30u; hash *= 0xBF58476D1CE4E5B9ull;
+	hash ^= hash >> 27u; hash *= 0x94D049BB133111EBull;
+	return hash ^ (hash >> 31u);
+}
+// MurmurHash3 finalizer, used for the check half.
+static inline uint64 mixCheckHash(uint64 hash) noexcept
+{
+	hash ^= hash >> 33u; hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33u; hash *= 0xC4CEB9FE1A85EC53ull;
+	return hash ^ (hash >> 33u);
+}
+
+static inline VoxelHash hashValue(uint64 value, const VoxelHash& seed = {}) noexcept
+{
+	return { mixHash(seed.key ^ value), mixCheckHash(seed.check ^ (value + 0x9E3779B97F4A7C15ull)) };
+}
+// Chains hashes in order, so that swapped values give a different result.
+static inline VoxelHash combineHash(const VoxelHash& hash, const VoxelHash& other) noexcept
+{
+	return { mixHash(hash.key ^ other.key), mixCheckHash(hash.check ^ other.check) };
+}
+
+// Four independent lanes to hide multiply latency, size should be a multiple of 32 bytes.
+static inline VoxelHash hashWords(const void* data, psize byteSize, const VoxelHash& seed = {}) noexcept
+{
+	GARDEN_ASSERT(byteSize % (sizeof(uint64) * 4) == 0);
+	auto words = (const uint64*)data;
+	auto wordCount = byteSize / sizeof(uint64);
+	uint64 lanes[4] = { seed.key, seed.check, seed.key + 1u, seed.check + 1u };
+
+	for (psize i = 0; i < wordCount; i += 4)
+	{
+		for (uint8 j = 0; j < 4; j++)
+		{
+			auto lane = lanes[j] ^ (words[i + j] * 0x9E3779B97F4A7C15ull);
+			lanes[j] = ((lane << 31u) | (lane >> 33u)) * 0xC2B2AE3D27D4EB4Full;
+		}
+	}
+
+	VoxelHash hash;
+	hash.key = mixHash(lanes[0] ^ mixHash(lanes[1] ^ mixHash(lanes[2] ^ mixHash(lanes[3]))));
+	hash.check = mixCheckHash(lanes[3] + mixCheckHash(lanes[2] + mixCheckHash(lanes[1] + mixCheckHash(lanes[0]))));
+	return hash;
+}
+
+} // namespace voxfield
@@ -0,0 +1,64 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "garden/defines.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace voxfield
+{
+
+using namespace std;
+
+// Background job handle, job is cancelled if its source generation has changed.
+// Generation counter is shared, so handle stays valid after the job source is released.
+class JobHandle final
+{
+	shared_ptr<atomic<uint32>> counter;
+	uint32 generation = 0;
+public:
+	JobHandle() = default;
+	JobHandle(const shared_ptr<atomic<uint32>>& counter) :
+		counter(counter), generation(counter->load(memory_order_relaxed)) { }
+
+	// Can be called from any thread, running jobs should check it between the stages.
+	bool isCancelled() const noexcept
+	{
+		return counter && counter->load(memory_order_relaxed) != generation;
+	}
+};
+
+// Job source generation counter, cancelling invalidates all previously started jobs.
+class JobCounter final
+{
+	shared_ptr<atomic<uint32>> counter;
+public:
+	JobHandle start()
+	{
+		if (!counter) counter = make_shared<atomic<uint32>>(0);
+		return JobHandle(counter);
+	}
+	void cancel() noexcept
+	{
+		if (counter) counter->fetch_add(1, memory_order_relaxed);
+	}
+};
+
+} // namespace voxfield
@@ -0,0 +1,271 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "voxfield/voxel.hpp"
+#include "voxfield/hash.hpp"
+#include "garden/defines.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+namespace voxfield
+{
+
+using namespace std;
+
+//----------------------------------------------------------------------------------------
+// Voxel palette with the bit packed palette indices, 1/2/4/8/16 bits per voxel.
+// Index size grows on insert of a new voxel, unused palette entries are kept until encode.
+class PaletteStorage final
+{
+	vector<Voxel> palette;
+	vector<uint64> words;
+	psize voxelCount = 0;
+	uint8 indexBits = 0;
+	uint16 lastIndex = 0; // Speeds up repeated inserts of the same voxel.
+	mutable VoxelHash contentHash = {};
+	mutable bool isContentHashed = false;
+
+	static uint8 getIndexBits(psize paletteSize) noexcept
+	{
+		if (paletteSize <= 2) return 1;
+		if (paletteSize <= 4) return 2;
+		if (paletteSize <= 16) return 4;
+		if (paletteSize <= 256) return 8;
+		return 16;
+	}
+
+	uint32 getIndex(psize index) const noexcept
+	{
+		auto bitIndex = index * indexBits;
+		return (uint32)(words[bitIndex >> 6u] >> (bitIndex & 63u)) & ((1u << indexBits) - 1u);
+	}
+	void setIndex(psize index, uint32 paletteIndex) noexcept
+	{
+		auto bitIndex = index * indexBits;
+		auto shift = bitIndex & 63u;
+		auto mask = (uint64)((1u << indexBits) - 1u) << shift;
+		auto& word = words[bitIndex >> 6u];
+		word = (word & ~mask) | ((uint64)paletteIndex << shift);
+	}
+
+	template<uint8 Bits>
+	static void encodeWords(const uint16* indices, uint64* words, psize voxelCount) noexcept
+	{
+		constexpr uint32 wordVoxelCount = 64u / Bits;
+		for (psize i = 0; i < voxelCount; i += wordVoxelCount)
+		{
+			uint64 word = 0;
+			for (uint32 j = 0; j < wordVoxelCount; j++)
+				word |= (uint64)indices[i + j] << (j * Bits);
+			*words++ = word;
+		}
+	}
+	template<uint8 Bits>
+	static void decodeWords(const uint64* words, const Voxel* palette,
+		psize paletteSize, Voxel* voxels, psize voxelCount) noexcept
+	{
+		constexpr uint32 wordVoxelCount = 64u / Bits;
+		constexpr uint64 mask = (1ull << Bits) - 1ull;
+
+		if constexpr (Bits <= 4)
+		{
+			// Small palettes are decoded a byte at a time, all byte values are looked up once.
+			// Words are little endian on all supported platforms, so bytes are in voxel order.
+			constexpr uint32 byteVoxelCount = 8u / Bits;
+			Voxel table[256][byteVoxelCount];
+			for (uint32 i = 0; i < 256; i++)
+			{
+				for (uint32 j = 0; j < byteVoxelCount; j++)
+				{
+					auto paletteIndex = (i >> (j * Bits)) & mask;
+					table[i][j] = paletteIndex < paletteSize ? palette[paletteIndex] : NULL_VOXEL;
+				}
+			}
+
+			auto bytes = (const uint8*)words;
+			for (psize i = 0; i < voxelCount; i += byteVoxelCount)
+				memcpy(voxels + i, table[*bytes++], sizeof(table[0]));
+		}
+		else
+		{
+			for (psize i = 0; i < voxelCount; i += wordVoxelCount)
+			{
+				auto word = *words++;
+				for (uint32 j = 0; j < wordVoxelCount; j++)
+					voxels[i + j] = palette[(word >> (j * Bits)) & mask];
+			}
+		}
+	}
+
+	// Repacks indices if the palette no longer fits into the current index size.
+	void reserveIndexBits(psize paletteSize)
+	{
+		auto newIndexBits = getIndexBits(paletteSize);
+		if (newIndexBits <= indexBits) return;
+
+		vector<uint64> newWords(voxelCount * newIndexBits / 64u);
+		for (psize i = 0; i < voxelCount; i++)
+		{
+			auto bitIndex = i * newIndexBits;
+			newWords[bitIndex >> 6u] |= (uint64)getIndex(i) << (bitIndex & 63u);
+		}
+		words = std::move(newWords);
+		indexBits = newIndexBits;
+	}
+public:
+	PaletteStorage() = default;
+	// Voxel count should be a multiple of 64.
+	PaletteStorage(const Voxel* voxels, psize voxelCount) { encode(voxels, voxelCount); }
+
+	// Builds minimal palette for the voxels, removing unused entries.
+	void encode(const Voxel* voxels, psize voxelCount)
+	{
+		GARDEN_ASSERT(voxels);
+		GARDEN_ASSERT(voxelCount > 0 && voxelCount % 64u == 0);
+		this->voxelCount = voxelCount;
+		palette.clear();
+		palette.push_back(voxels[0]);
+		lastIndex = 0;
+
+		// Most of the chunks have less than 16 voxel types, so indices are found linearly.
+		vector<uint16> indices(voxelCount);
+		auto lastVoxel = voxels[0]; uint16 lastPaletteIndex = 0;
+		auto findIndex = [&](Voxel voxel)
+		{
+			if (voxel == lastVoxel) return lastPaletteIndex;
+			auto result = std::find(palette.begin(), palette.end(), voxel);
+			if (result == palette.end())
+			{
+				lastPaletteIndex = (uint16)palette.size();
+				palette.push_back(voxel);
+			}
+			else
+			{
+				lastPaletteIndex = (uint16)(result - palette.begin());
+			}
+			lastVoxel = voxel;
+			return lastPaletteIndex;
+		};
+
+		// Rows of the same voxel are common, they are checked without the branches.
+		for (psize i = 0; i < voxelCount; i += 32)
+		{
+			auto row = voxels + i;
+			auto firstVoxel = row[0];
+			uint32 difference = 0;
+			for (uint32 j = 1; j < 32; j++) difference |= row[j] ^ firstVoxel;
+
+			if (difference == 0)
+			{
+				auto paletteIndex = findIndex(firstVoxel);
+				std::fill(indices.begin() + i, indices.begin() + i + 32, paletteIndex);
+			}
+			else
+			{
+				for (uint32 j = 0; j < 32; j++) indices[i + j] = findIndex(row[j]);
+			}
+		}
+
+		indexBits = getIndexBits(palette.size());
+		words.resize(voxelCount * indexBits / 64u);
+		switch (indexBits)
+		{
+		case 1: encodeWords<1>(indices.data(), words.data(), voxelCount); break;
+		case 2: encodeWords<2>(indices.data(), words.data(), voxelCount); break;
+		case 4: encodeWords<4>(indices.data(), words.data(), voxelCount); break;
+		case 8: encodeWords<8>(indices.data(), words.data(), voxelCount); break;
+		case 16: encodeWords<16>(indices.data(), words.data(), voxelCount); break;
+		default: abort();
+		}
+
+		contentHash = hashWords(voxels, voxelCount * sizeof(Voxel));
+		isContentHashed = true;
+	}
+	// Writes all voxels to the flat array, fast bulk decode for the mesher.
+	void decode(Voxel* voxels) const noexcept
+	{
+		GARDEN_ASSERT(voxels);
+		switch (indexBits)
+		{
+		case 1: decodeWords<1>(words.data(), palette.data(), palette.size(), voxels, voxelCount); break;
+		case 2: decodeWords<2>(words.data(), palette.data(), palette.size(), voxels, voxelCount); break;
+		case 4: decodeWords<4>(words.data(), palette.data(), palette.size(), voxels, voxelCount); break;
+		case 8: decodeWords<8>(words.data(), palette.data(), palette.size(), voxels, voxelCount); break;
+		case 16: decodeWords<16>(words.data(), palette.data(), palette.size(), voxels, voxelCount); break;
+		default: abort();
+		}
+	}
+
+	Voxel get(psize index) const noexcept
+	{
+		GARDEN_ASSERT(index < voxelCount);
+		return palette[getIndex(index)];
+	}
+	void set(psize index, Voxel voxel)
+	{
+		GARDEN_ASSERT(index < voxelCount);
+		if (palette[lastIndex] != voxel)
+		{
+			auto result = std::find(palette.begin(), palette.end(), voxel);
+			if (result == palette.end())
+			{
+				GARDEN_ASSERT(palette.size() <= UINT16_MAX);
+				reserveIndexBits(palette.size() + 1);
+				lastIndex = (uint16)palette.size();
+				palette.push_back(voxel);
+			}
+			else
+			{
+				lastIndex = (uint16)(result - palette.begin());
+			}
+		}
+		setIndex(index, lastIndex);
+		isContentHashed = false;
+	}
+
+	// Returns hash of the decoded voxels, same as for the flat voxel array. Unused palette
+	// entries do not change it. Computed on encode, edited storage is decoded to rehash it.
+	const VoxelHash& getContentHash() const
+	{
+		if (!isContentHashed)
+		{
+			vector<Voxel> voxels(voxelCount);
+			decode(voxels.data());
+			contentHash = hashWords(voxels.data(), voxelCount * sizeof(Voxel));
+			isContentHashed = true;
+		}
+		return contentHash;
+	}
+
+	psize getVoxelCount() const noexcept { return voxelCount; }
+	psize getPaletteSize() const noexcept { return palette.size(); }
+	uint8 getIndexBits() const noexcept { return indexBits; }
+	const Voxel* getPalette() const noexcept { return palette.data(); }
+	const uint64* getWords() const noexcept { return words.data(); }
+	psize getWordCount() const noexcept { return words.size(); }
+	// Returns resident palette and index memory size in bytes.
+	psize getMemorySize() const noexcept
+	{
+		return sizeof(PaletteStorage) + palette.capacity() * sizeof(Voxel) + words.capacity() * sizeof(uint64);
+	}
+};
+
+} // namespace voxfield
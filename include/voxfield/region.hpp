@@ -0,0 +1,129 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "voxfield/chunk.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+namespace voxfield
+{
+
+namespace fs = std::filesystem;
+
+// Region file chunk count along each axis
+#define REGION_LENGTH 8
+// REGION_LENGTH ^ 3
+#define REGION_SIZE 512
+// Region file header magic "VXRG"
+#define REGION_MAGIC 0x47525856u
+#define REGION_VERSION 1u
+
+//----------------------------------------------------------------------------------------
+// World chunk storage in the region files of REGION_SIZE chunks. File starts with the
+// header index of chunk payload offsets and sizes, payload is run length encoded voxels.
+// Reads go through the read only file mapping, writes are batched by the writer thread.
+// Only recently used regions are kept open, idle ones are closed after their writes.
+// Changed payload is appended to the file end, old space is not reused until compaction.
+class RegionStorage final
+{
+public:
+	struct Entry final
+	{
+		uint32 offset = 0; // Zero if chunk is not stored.
+		uint32 size = 0;
+	};
+	struct Stats final
+	{
+		uint64 loadCount = 0;
+		uint64 saveCount = 0;
+		uint64 readBytes = 0;
+		uint64 writtenBytes = 0;
+	};
+private:
+	struct Region final
+	{
+		mutex regionMutex;
+		FILE* file = nullptr;
+		const uint8* mapping = nullptr;
+		psize mappingSize = 0;
+		psize fileSize = 0; // Size of the written and published payloads.
+		Entry index[REGION_SIZE] = {};
+		int3 position = int3(0);
+		uint64 lastUse = 0; // Guarded by the storage regionMutex, as the use count.
+		uint32 useCount = 0;
+	};
+
+	fs::path directory;
+	unordered_map<uint64, unique_ptr<Region>> regions;
+	unordered_map<uint64, Chunk> pendingChunks;
+	unordered_map<uint64, Chunk> writingChunks;
+	vector<Voxel> writeVoxels;
+	vector<uint8> writePayload;
+	mutex regionMutex;
+	mutex saveMutex;
+	condition_variable saveCondition;
+	condition_variable flushCondition;
+	thread writer;
+	atomic<uint64> loadCount = 0;
+	atomic<uint64> saveCount = 0;
+	atomic<uint64> readBytes = 0;
+	atomic<uint64> writtenBytes = 0;
+	uint64 useTick = 0;
+	uint32 maxOpenRegions = 0;
+	bool isRunning = true;
+
+	Region* acquireRegion(const int3& regionPosition);
+	void releaseRegion(Region* region);
+	void closeIdleRegions(psize maxCount);
+	bool readChunk(Region* region, const int3& position, Chunk& chunk);
+	void writeChunks();
+	void runWriter();
+public:
+	// Creates storage directory if it does not exist. Regions in use are not closed,
+	// so open region count can briefly exceed the maximum.
+	RegionStorage(const fs::path& directory, uint32 maxOpenRegions = 64);
+	// Waits until all saved chunks are written.
+	~RegionStorage();
+
+	RegionStorage(const RegionStorage&) = delete;
+	RegionStorage& operator=(const RegionStorage&) = delete;
+
+	// Thread safe, replaces chunk voxels with the stored ones if they exist.
+	bool tryLoad(const int3& position, Chunk& chunk);
+	// Queues chunk voxels snapshot for the writer, newer save replaces the queued one.
+	void save(const Chunk& chunk);
+	// Blocks until all queued chunks are written to the region files.
+	void flush();
+
+	const fs::path& getDirectory() const noexcept { return directory; }
+	uint32 getMaxOpenRegions() const noexcept { return maxOpenRegions; }
+	Stats getStats() const noexcept;
+
+	// Run length encodes chunk voxels in the linear order, so files do not depend on layout.
+	static void encode(const Chunk& chunk, vector<uint8>& payload, vector<Voxel>& voxels);
+	// Returns false if payload is corrupted.
+	static bool decode(const uint8* payload, psize size, Chunk& chunk);
+};
+
+} // namespace voxfield
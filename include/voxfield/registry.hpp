@@ -26,11 +26,35 @@ namespace voxfield
 
 using namespace std;
 
+// Voxel face culling decision
+enum class FaceCull : uint8
+{
+	None, Always, SameHollow, Count
+};
+
+// Voxel ID range bitset size in 64bit words (65536 / 64)
+#define VOXEL_BITSET_SIZE 1024
+
 class Registry
 {
 protected:
 	vector<VoxelData> voxelData;
+	vector<uint64> opaqueBits;
+	vector<uint64> transparentBits;
+	vector<uint64> hollowBits;
+	vector<VoxelDrawMode> drawModes;
+	// Face culling decision for [voxel draw mode][near voxel draw mode] pair.
+	FaceCull faceCulls[(uint8)VoxelDrawMode::Count][(uint8)VoxelDrawMode::Count] = {};
 	bool isFinalized = false;
+
+	static bool getBit(const vector<uint64>& bits, Voxel voxel) noexcept
+	{
+		return (bits[voxel >> 6u] >> (voxel & 63u)) & 1u;
+	}
+	static void setBit(vector<uint64>& bits, Voxel voxel) noexcept
+	{
+		bits[voxel >> 6u] |= (uint64)1u << (voxel & 63u);
+	}
 public:
 	Registry()
 	{
@@ -61,14 +85,84 @@ public:
 		voxelData.push_back(data);
 		return voxel;
 	}
-	void finalize() noexcept { isFinalized = true; }
+
+	// Compiles dense voxel property tables used by the hot paths.
+	void finalize() noexcept
+	{
+		GARDEN_ASSERT(!isFinalized);
+		opaqueBits.assign(VOXEL_BITSET_SIZE, 0);
+		transparentBits.assign(VOXEL_BITSET_SIZE, 0);
+		hollowBits.assign(VOXEL_BITSET_SIZE, 0);
+		drawModes.resize(voxelData.size());
+
+		for (psize i = 0; i < voxelData.size(); i++)
+		{
+			const auto& data = voxelData[i];
+			drawModes[i] = data.drawMode;
+			if (data.drawMode == VoxelDrawMode::Opaque) setBit(opaqueBits, (Voxel)i);
+			else if (data.drawMode == VoxelDrawMode::Transparent) setBit(transparentBits, (Voxel)i);
+			if (data.isHollow) setBit(hollowBits, (Voxel)i);
+		}
+
+		// Not registered voxels are drawn as unknown ones.
+		const auto& unknownData = voxelData[UNKNOWN_VOXEL];
+		for (psize i = voxelData.size(); i <= UINT16_MAX; i++)
+		{
+			if (unknownData.drawMode == VoxelDrawMode::Opaque) setBit(opaqueBits, (Voxel)i);
+			else if (unknownData.drawMode == VoxelDrawMode::Transparent) setBit(transparentBits, (Voxel)i);
+			if (unknownData.isHollow) setBit(hollowBits, (Voxel)i);
+		}
+
+		for (uint8 i = 0; i < (uint8)VoxelDrawMode::Count; i++)
+		{
+			for (uint8 j = 0; j < (uint8)VoxelDrawMode::Count; j++)
+			{
+				if (i == (uint8)VoxelDrawMode::Transparent || j == (uint8)VoxelDrawMode::Opaque)
+					faceCulls[i][j] = FaceCull::Always;
+				else if (i == j) faceCulls[i][j] = FaceCull::SameHollow;
+				else faceCulls[i][j] = FaceCull::None;
+			}
+		}
+
+		isFinalized = true;
+	}
 
 	const VoxelData& getVoxelData(Voxel voxel) const noexcept
 	{
 		GARDEN_ASSERT(isFinalized);
-		if (voxel > voxelData.size()) return voxelData[UNKNOWN_VOXEL];
+		if (voxel >= voxelData.size()) return voxelData[UNKNOWN_VOXEL];
 		return voxelData[voxel];
 	}
+
+	bool isOpaque(Voxel voxel) const noexcept
+	{
+		GARDEN_ASSERT(isFinalized);
+		return getBit(opaqueBits, voxel);
+	}
+	bool isTransparent(Voxel voxel) const noexcept
+	{
+		GARDEN_ASSERT(isFinalized);
+		return getBit(transparentBits, voxel);
+	}
+	bool isHollow(Voxel voxel) const noexcept
+	{
+		GARDEN_ASSERT(isFinalized);
+		return getBit(hollowBits, voxel);
+	}
+	VoxelDrawMode getDrawMode(Voxel voxel) const noexcept
+	{
+		GARDEN_ASSERT(isFinalized);
+		return voxel < drawModes.size() ? drawModes[voxel] : drawModes[UNKNOWN_VOXEL];
+	}
+
+	// Returns true if voxel face touching the near voxel should be drawn.
+	bool shouldDrawFace(Voxel voxel, Voxel nearVoxel) const noexcept
+	{
+		auto faceCull = faceCulls[(uint8)getDrawMode(voxel)][(uint8)getDrawMode(nearVoxel)];
+		if (faceCull == FaceCull::Always) return false;
+		if (faceCull == FaceCull::SameHollow) return voxel != nearVoxel || !isHollow(voxel);
+		return true;
+	}
 };
 
 } // namespace voxfield
\ No newline at end of file
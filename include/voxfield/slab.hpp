@@ -0,0 +1,75 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#pragma once
+#include "math/types.hpp"
+#include "garden/defines.hpp"
+
+#include <mutex>
+#include <vector>
+
+namespace voxfield
+{
+
+using namespace std;
+using namespace math;
+
+// Large page size on the most of the x86 and ARM systems
+#define SLAB_SIZE (2 * 1024 * 1024)
+
+//----------------------------------------------------------------------------------------
+// Fixed size block allocator, blocks are carved from 2MB slabs that are kept until
+// destruction. Slabs are backed by the huge pages if the system allows it, so streamed
+// chunk storage neither touches the heap nor page faults after the pool is warmed up.
+class SlabAllocator final
+{
+	vector<uint8*> slabs;
+	vector<uint8*> freeBlocks;
+	mutex blockMutex;
+	psize blockSize = 0;
+	uint32 blocksPerSlab = 0;
+	uint32 hugeSlabCount = 0;
+	bool useHugePages = false;
+
+	void addSlab(bool prefault);
+public:
+	SlabAllocator(psize blockSize, bool useHugePages = true);
+	~SlabAllocator();
+
+	SlabAllocator(const SlabAllocator&) = delete;
+	SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+	// Thread safe, allocates new slab if there are no free blocks.
+	void* allocate();
+	void free(void* block) noexcept;
+	// Allocates and pre-faults slabs until there are at least count free blocks.
+	void reserve(psize count);
+
+	psize getBlockSize() const noexcept { return blockSize; }
+	psize getSlabCount() const noexcept { return slabs.size(); }
+	// Returns count of the slabs backed by the huge pages.
+	uint32 getHugeSlabCount() const noexcept { return hugeSlabCount; }
+	psize getBlockCount() const noexcept { return slabs.size() * blocksPerSlab; }
+	psize getFreeCount() noexcept
+	{
+		lock_guard<mutex> lock(blockMutex);
+		return freeBlocks.size();
+	}
+};
+
+} // namespace voxfield
@@ -18,10 +18,13 @@
 
 #pragma once
 #include "voxfield/chunk.hpp"
+#include "voxfield/chunkmap.hpp"
+#include "voxfield/region.hpp"
 #include "voxfield/client/system/render/geometry/opaque.hpp"
 
-#include <map>
+#include <list>
 #include <stack>
+#include <unordered_map>
 
 namespace voxfield
 {
@@ -67,25 +70,119 @@ static constexpr void hashToChunkPos(uint64 hash, int3& position) noexcept
 //----------------------------------------------------------------------------------------
 class Structure
 {
+public:
+	struct EvictionStats final
+	{
+		psize inactiveCount = 0;
+		psize inactiveSize = 0; // Voxel, mesh and chunk bytes of the inactive chunks.
+		psize inactiveBudget = 0;
+		uint64 hitCount = 0; // Inactive chunks reactivated on the view re-entry.
+		uint64 addCount = 0; // Chunks created, new, evicted before or border ones.
+		uint64 evictCount = 0;
+
+		// Returns share of the chunks appearing in the structure that were reactivated.
+		float getReuseRate() const noexcept
+		{
+			auto count = hitCount + addCount;
+			return count > 0 ? (float)hitCount / count : 0.0f;
+		}
+	};
 protected:
+	struct InactiveChunk final
+	{
+		uint64 hash = 0;
+		psize byteSize = 0;
+	};
+
 	Manager* manager = nullptr;
-	GraphicsSystem* graphicsSystem = nullptr;
+	MesherSystem* mesherSystem = nullptr;
 	stack<Chunk*>* freeChunks = nullptr;
-	map<uint64, Chunk*> chunks;
+	RegionStorage* storage = nullptr;
+	ChunkMap chunks;
+	vector<uint64> editedChunks;
+	list<InactiveChunk> inactiveChunks; // Most recently deactivated first.
+	unordered_map<uint64, list<InactiveChunk>::iterator> inactiveLookup;
+	EvictionStats evictionStats = {};
 	uint32 id = 0;
+
+	Chunk* createChunk()
+	{
+		auto entity = manager->createEntity();
+		manager->add<TransformComponent>(entity);
+		auto opaqVoxComponent = manager->add<OpaqVoxRenderComponent>(entity);
+		opaqVoxComponent->aabb.setSize(float3(CHUNK_LENGTH));
+		opaqVoxComponent->isEnabled = false;
+		return new Chunk(NULL_VOXEL, int3(0), id, entity);
+	}
+
+	void removeInactive(uint64 hash)
+	{
+		auto result = inactiveLookup.find(hash);
+		GARDEN_ASSERT(result != inactiveLookup.end());
+		evictionStats.inactiveSize -= result->second->byteSize;
+		inactiveChunks.erase(result->second);
+		inactiveLookup.erase(result);
+		evictionStats.inactiveCount = inactiveChunks.size();
+	}
+	// Hides chunk but keeps its voxels and mesh, interrupted jobs are restarted on re-entry.
+	void deactivateChunk(uint64 hash, Chunk* chunk)
+	{
+		auto opaqVoxComponent = manager->get<OpaqVoxRenderComponent>(chunk->getEntity());
+		opaqVoxComponent->isEnabled = false;
+		chunk->jobs.cancel();
+		if (chunk->state == ChunkState::Generating) chunk->state = ChunkState::Allocated;
+		else if (chunk->state == ChunkState::Meshing) chunk->state = ChunkState::Generated;
+		chunk->isInactive = true;
+
+		InactiveChunk inactiveChunk;
+		inactiveChunk.hash = hash;
+		inactiveChunk.byteSize = sizeof(Chunk) + chunk->getStorageSize() +
+			opaqVoxComponent->allocation.byteSize;
+		inactiveChunks.push_front(inactiveChunk);
+		inactiveLookup.emplace(hash, inactiveChunks.begin());
+		evictionStats.inactiveSize += inactiveChunk.byteSize;
+		evictionStats.inactiveCount = inactiveChunks.size();
+	}
+	// Frees chunk mesh and returns chunk to the free ones, it should be erased from the map.
+	void releaseChunk(uint64 hash, Chunk* chunk)
+	{
+		auto opaqVoxComponent = manager->get<OpaqVoxRenderComponent>(chunk->getEntity());
+		mesherSystem->freeMesh(opaqVoxComponent->allocation);
+		opaqVoxComponent->isEnabled = false;
+		chunk->jobs.cancel(); // Queued and running chunk jobs are dropped by the workers.
+		if (chunk->isInactive)
+		{
+			removeInactive(hash);
+			chunk->isInactive = false;
+		}
+		if (freeChunks) freeChunks->push(chunk);
+	}
+	void reactivateChunk(uint64 hash, Chunk* chunk)
+	{
+		removeInactive(hash);
+		chunk->isInactive = false;
+		auto opaqVoxComponent = manager->get<OpaqVoxRenderComponent>(chunk->getEntity());
+		opaqVoxComponent->isEnabled = opaqVoxComponent->allocation.isValid();
+		evictionStats.hitCount++;
+	}
 public:
 	Structure() = default;
-	Structure(Manager* manager, uint32 id, stack<Chunk*>* freeChunks)
+	Structure(Manager* manager, uint32 id, stack<Chunk*>* freeChunks,
+		RegionStorage* storage = nullptr)
 	{
 		GARDEN_ASSERT(manager);
 		this->manager = manager;
 		this->freeChunks = freeChunks;
+		this->storage = storage;
 		this->id = id;
-		graphicsSystem = manager->get<GraphicsSystem>();
+		mesherSystem = manager->get<MesherSystem>();
 	}
 
-	map<uint64, Chunk*>& getChunks() noexcept { return chunks; }
-	const map<uint64, Chunk*>& getChunks() const noexcept { return chunks; }
+	ChunkMap& getChunks() noexcept { return chunks; }
+	const ChunkMap& getChunks() const noexcept { return chunks; }
+	// Returns hashes of chunks with voxel edits since the last clear.
+	vector<uint64>& getEditedChunks() noexcept { return editedChunks; }
+	const EvictionStats& getEvictionStats() const noexcept { return evictionStats; }
 
 	Chunk* getChunk(uint64 hash)
 	{
@@ -109,30 +206,37 @@ public:
 	}
 
 //----------------------------------------------------------------------------------------
+	// Creates free chunks with their entities up front, so that view streaming reuses them.
+	void reserveChunks(psize count)
+	{
+		GARDEN_ASSERT(freeChunks);
+		chunks.reserve(count);
+		while (chunks.size() + freeChunks->size() < count)
+			freeChunks->push(createChunk());
+	}
+
 	Chunk* addChunk(const int3& position, Voxel voxel = NULL_VOXEL)
 	{
 		Chunk* chunk;
-		View<TransformComponent> transformComponent;
-
 		if (freeChunks && freeChunks->size() > 0)
 		{
 			chunk = freeChunks->top();
 			freeChunks->pop();
-			chunk->fill(voxel);
-			chunk->state = ChunkState::Allocated;
-			chunk->position = position;
-			transformComponent = manager->get<TransformComponent>(chunk->getEntity());
 		}
 		else
 		{
-			auto entity = manager->createEntity();
-			transformComponent = manager->add<TransformComponent>(entity);
-			auto opaqVoxComponent = manager->add<OpaqVoxRenderComponent>(entity);
-			opaqVoxComponent->aabb.setSize(float3(CHUNK_LENGTH));
-			opaqVoxComponent->isEnabled = false;
-			chunk = new Chunk(voxel, position, id, entity);
+			chunk = createChunk();
 		}
 
+		chunk->fill(voxel);
+		chunk->dirtySlices = {};
+		chunk->state = ChunkState::Allocated;
+		chunk->isUnsaved = false;
+		chunk->isInactive = false;
+		chunk->position = position;
+		evictionStats.addCount++;
+		auto transformComponent = manager->get<TransformComponent>(chunk->getEntity());
+
 		auto hash = posToChunkHash(position);
 		auto result = chunks.emplace(hash, chunk).second;
 
@@ -161,6 +265,33 @@ public:
 		return addChunk(position, voxel);
 	}
 
+//----------------------------------------------------------------------------------------
+	bool tryGetVoxel(const int3& position, Voxel& voxel)
+	{
+		int3 voxelPosition; Chunk* chunk;
+		if (!tryGetChunk(worldToChunkPos(position, voxelPosition), chunk) ||
+			(uint8)chunk->state < (uint8)ChunkState::Generated) return false;
+		voxel = chunk->get(voxelPosition.x, voxelPosition.y, voxelPosition.z);
+		return true;
+	}
+
+	// Sets world voxel and records the edited chunk, returns false if it is not loaded.
+	bool trySetVoxel(const int3& position, Voxel voxel)
+	{
+		int3 voxelPosition;
+		auto chunkPosition = worldToChunkPos(position, voxelPosition);
+		auto hash = posToChunkHash(chunkPosition);
+
+		Chunk* chunk;
+		if (!tryGetChunk(hash, chunk) || chunk->isInactive ||
+			(uint8)chunk->state < (uint8)ChunkState::Generated) return false;
+
+		auto wasDirty = chunk->dirtySlices.isDirty();
+		if (chunk->edit(voxelPosition.x, voxelPosition.y, voxelPosition.z, voxel) && !wasDirty)
+			editedChunks.push_back(hash);
+		return true;
+	}
+
 //----------------------------------------------------------------------------------------
 	void removeChunk(uint64 hash)
 	{
@@ -176,7 +307,7 @@ public:
 		}
 		#endif
 
-		if (freeChunks) freeChunks->push(result->second);
+		releaseChunk(hash, result->second);
 		chunks.erase(result);
 	}
 	void removeChunk(const int3& position)
@@ -188,7 +319,7 @@ public:
 	{
 		auto result = chunks.find(hash);
 		if (result == chunks.end()) return false;
-		if (freeChunks) freeChunks->push(result->second);
+		releaseChunk(hash, result->second);
 		chunks.erase(result);
 		return true;
 	}
@@ -197,20 +328,47 @@ public:
 		return tryRemoveChunk(posToChunkHash(position));
 	}
 
-	void removeOutOfView(const int3& position, int32 radius)
+	// Queues generated chunk with changed voxels for the region storage writer.
+	bool trySaveChunk(Chunk* chunk)
+	{
+		GARDEN_ASSERT(storage);
+		if (!chunk->isUnsaved || (uint8)chunk->state < (uint8)ChunkState::Generated) return false;
+		storage->save(*chunk);
+		chunk->isUnsaved = false;
+		return true;
+	}
+	// Saves all loaded chunks with changed voxels, used before exit.
+	void saveChunks()
+	{
+		if (!storage) return;
+		for (const auto& pair : chunks) trySaveChunk(pair.second);
+	}
+
+	// Chunks leaving the view stay inactive with their voxels and meshes for a cheap re-entry,
+	// least recently deactivated ones are saved and freed when the budget is exceeded.
+	void removeOutOfView(const int3& position, int32 radius, psize inactiveBudget)
 	{
 		auto radius2 = radius * radius;
-		for (auto i = chunks.begin(); i != chunks.end();)
+		for (const auto& pair : chunks)
+		{
+			auto chunk = pair.second;
+			int3 chunkPosition; hashToChunkPos(pair.first, chunkPosition);
+			auto isInView = distance2(position, chunkPosition) <= radius2;
+			if (isInView != chunk->isInactive) continue;
+			if (isInView) reactivateChunk(pair.first, chunk);
+			else deactivateChunk(pair.first, chunk);
+		}
+
+		evictionStats.inactiveBudget = inactiveBudget;
+		while (evictionStats.inactiveSize > inactiveBudget)
 		{
-			int3 chunkPosition; hashToChunkPos(i->first, chunkPosition);
-			if (distance2(position, chunkPosition) <= radius2) { i++; continue; }
-			auto opaqVoxComponent = manager->get<
-				OpaqVoxRenderComponent>(i->second->getEntity());
-			graphicsSystem->destroy(opaqVoxComponent->vertexBuffer);
-			opaqVoxComponent->vertexBuffer = {};
-			opaqVoxComponent->isEnabled = false;
-			if (freeChunks) freeChunks->push(i->second);
-			i = chunks.erase(i);
+			auto hash = inactiveChunks.back().hash;
+			auto result = chunks.find(hash);
+			GARDEN_ASSERT(result != chunks.end());
+			if (storage) trySaveChunk(result->second);
+			releaseChunk(hash, result->second);
+			chunks.erase(result);
+			evictionStats.evictCount++;
 		}
 	}
 };
@@ -17,7 +17,7 @@
 //----------------------------------------------------------------------------------------
 
 #pragma once
-#include "voxfield/chunk.hpp"
+#include "voxfield/region.hpp"
 #include "garden/system/thread.hpp"
 
 namespace voxfield
@@ -33,11 +33,22 @@ enum class GenType : uint8
 
 class GeneratorSystem final : public System
 {
+	struct GeneratedChunk final
+	{
+		Chunk* chunk = nullptr;
+		JobHandle job = {};
+	};
+
 	ThreadSystem* threadSystem = nullptr;
 	void** noiseGens = nullptr;
-	vector<Chunk*> chunks;
+	vector<GeneratedChunk> chunks;
+	vector<GeneratedChunk> flushChunks;
+	vector<Chunk*> freeChunks;
 	mutex chunkMutex;
 	uint32 noiseCount = 0;
+	uint32 pendingCount = 0;
+	uint32 cancelledCount = 0;
+	RegionStorage* storage = nullptr;
 
 	void initialize() final;
 	void terminate() final;
@@ -48,8 +59,19 @@ class GeneratorSystem final : public System
 	
 	friend class ecsm::Manager;
 public:
-	void generateChunk(const int3& position, uint32 structureID, GenType genType);
-	void flush(std::function<void(const Chunk*)> onChunk);
+	// Stored chunks are loaded instead of generating them, if set. Waits for the running
+	// background tasks, so that workers never read the previous storage.
+	void setStorage(RegionStorage* storage);
+	RegionStorage* getStorage() const noexcept { return storage; }
+
+	// Generated chunk is dropped if the job is cancelled before it is flushed.
+	void generateChunk(const int3& position, uint32 structureID,
+		GenType genType, const JobHandle& job = {});
+	// Generated chunk storage can be swapped out in the callback, chunk is reused after it.
+	// Chunks of the jobs cancelled before the flush are not passed to the callback.
+	void flush(std::function<void(Chunk*)> onChunk);
+	// Returns count of the generating chunks not flushed yet.
+	uint32 getPendingCount() const noexcept { return pendingCount; }
 };
 
 } // namespace voxfield
\ No newline at end of file
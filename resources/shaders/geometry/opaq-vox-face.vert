@@ -0,0 +1,51 @@
+//--------------------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//--------------------------------------------------------------------------------------------------
+
+#include "common/chunk.gsl"
+
+out float2 fs.texCoords;
+out float3 fs.normal;
+out float fs.occlusion;
+
+uniform pushConstants
+{
+	uint32 instanceIndex;
+} pc;
+
+buffer readonly Instance
+{
+	InstanceData data[];
+} instance;
+
+buffer readonly set1 Faces
+{
+	uint2 data[];
+} faces;
+
+// Vertex pulling variant, shared quad index buffer addresses 4 vertices per face.
+// Vertex index includes chunk heap allocation offset, so faces are read from the page.
+void main()
+{
+	uint2 face = faces.data[gl.vertexIndex >> 2u];
+	uint32 corner = gl.vertexIndex & 3u;
+	float4 position = float4(decodeChunkFacePosition(face, corner), 1.0f);
+	gl.position = instance.data[pc.instanceIndex].mvp * position;
+	fs.texCoords = float2(0.0f); // Faces store no texture coordinates, same as vertices.
+	fs.normal = decodeChunkFaceNormal(face);
+	fs.occlusion = decodeChunkFaceOcclusion(face, corner);
+}
@@ -27,6 +27,7 @@ pipelineState
 
 in float2 fs.texCoords;
 in float3 fs.normal;
+in float fs.occlusion;
 
 out float4 fb.gBuffer0;
 out float4 fb.gBuffer1;
@@ -34,7 +35,7 @@ out float4 fb.gBuffer2;
 
 void main()
 {
-	float3 color = float3(1.0f);
+	float3 color = float3(fs.occlusion);
 	float metallic = 0.0f;
 	float roughness = 1.0f;
 	float reflectance = 0.5f;
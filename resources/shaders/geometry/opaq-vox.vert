@@ -22,6 +22,7 @@ in uint2 vs.data : u32;
 
 out float2 fs.texCoords;
 out float3 fs.normal;
+out float fs.occlusion;
 
 uniform pushConstants
 {
@@ -39,6 +40,7 @@ void main()
 	gl.position = instance.data[pc.instanceIndex].mvp * position;
 	fs.texCoords = decodeChunkTexCoords(vs.data);
 	fs.normal = decodeChunkNormal(vs.data);
+	fs.occlusion = decodeChunkOcclusion(vs.data);
 }
 
 // TODO: create separate shader with normals update for mooving objects.
\ No newline at end of file
@@ -20,619 +20,282 @@
 #include "voxfield/client/system/world.hpp"
 #include "garden/graphics/api.hpp"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 using namespace voxfield;
 using namespace voxfield::client;
 
 namespace
 {
-	struct MeshCluster final : public Cluster
+	// Occlusion masks in the face mask slice layouts, X sides use transposed rows.
+	struct MeshOcclusion final
 	{
+		OcclusionMasks natural;
+		OcclusionMasks transposed;
+	};
+
+	// Center chunk copy shares packed voxel storage with the world chunk, so it is a cheap
+	// snapshot, and the world can edit its chunks while the mesh is generated.
+	// Downsampled LOD reads whole blocks of the near chunks, so they are copied instead of slices.
+	struct MeshCluster final
+	{
+		SliceCluster slices;
+		Chunk nearChunks[VOXEL_SIDE_COUNT];
 		MesherSystem* system = nullptr;
+		MeshMode meshMode = {};
+		MeshFormat meshFormat = {};
+		JobHandle job = {};
+		VoxelHash hash = {};
 
-		MeshCluster(MesherSystem* system = nullptr, Chunk* c = nullptr,
-			Chunk* nx = nullptr, Chunk* px = nullptr,
-			Chunk* ny = nullptr, Chunk* py = nullptr,
-			Chunk* nz = nullptr, Chunk* pz = nullptr) :
-			Cluster(c, nx, px, ny, py, nz, pz) { this->system = system; }
+		MeshCluster(MesherSystem* system, const Cluster& cluster, MeshMode meshMode) : slices(
+			cluster.c->lod > 0 ? SliceCluster(*cluster.c) : SliceCluster(cluster, false))
+		{
+			this->system = system;
+			this->meshMode = meshMode;
+			this->meshFormat = system->meshFormat;
+
+			if (cluster.c->lod > 0)
+			{
+				nearChunks[0] = *cluster.nx; nearChunks[1] = *cluster.px;
+				nearChunks[2] = *cluster.ny; nearChunks[3] = *cluster.py;
+				nearChunks[4] = *cluster.nz; nearChunks[5] = *cluster.pz;
+			}
+		}
 	};
 };
 
-//--------------------------------------------------------------------------------------------------
-static void generateSideNX(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	vertices[vertexIndex    ] = ChunkVertex(x    , y    , z + 1, 0);
-	vertices[vertexIndex + 1] = ChunkVertex(x    , y + 1, z + 1, 0);
-	vertices[vertexIndex + 2] = ChunkVertex(x    , y + 1, z    , 0);
-	vertices[vertexIndex + 3] = ChunkVertex(x    , y    , z    , 0);
-}
-static void generateSidePX(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	vertices[vertexIndex    ] = ChunkVertex(x + 1, y    , z    , 1);
-	vertices[vertexIndex + 1] = ChunkVertex(x + 1, y + 1, z    , 1);
-	vertices[vertexIndex + 2] = ChunkVertex(x + 1, y + 1, z + 1, 1);
-	vertices[vertexIndex + 3] = ChunkVertex(x + 1, y    , z + 1, 1);
-}
-static void generateSideNY(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	vertices[vertexIndex    ] = ChunkVertex(x    , y    , z + 1, 2);
-	vertices[vertexIndex + 1] = ChunkVertex(x    , y    , z    , 2);
-	vertices[vertexIndex + 2] = ChunkVertex(x + 1, y    , z    , 2);
-	vertices[vertexIndex + 3] = ChunkVertex(x + 1, y    , z + 1, 2);
-}
-static void generateSidePY(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	vertices[vertexIndex    ] = ChunkVertex(x    , y + 1, z    , 3);
-	vertices[vertexIndex + 1] = ChunkVertex(x    , y + 1, z + 1, 3);
-	vertices[vertexIndex + 2] = ChunkVertex(x + 1, y + 1, z + 1, 3);
-	vertices[vertexIndex + 3] = ChunkVertex(x + 1, y + 1, z    , 3);
-}
-static void generateSideNZ(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+// Downsampled blocks are merged by the greedy mode, per face LOD would not reduce quads.
+static MeshMode getLODMeshMode(MeshMode meshMode, uint8 lod) noexcept
 {
-	vertices[vertexIndex    ] = ChunkVertex(x    , y    , z    , 4);
-	vertices[vertexIndex + 1] = ChunkVertex(x    , y + 1, z    , 4);
-	vertices[vertexIndex + 2] = ChunkVertex(x + 1, y + 1, z    , 4);
-	vertices[vertexIndex + 3] = ChunkVertex(x + 1, y    , z    , 4);
-}
-static void generateSidePZ(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	vertices[vertexIndex    ] = ChunkVertex(x + 1, y    , z + 1, 5);
-	vertices[vertexIndex + 1] = ChunkVertex(x + 1, y + 1, z + 1, 5);
-	vertices[vertexIndex + 2] = ChunkVertex(x    , y + 1, z + 1, 5);
-	vertices[vertexIndex + 3] = ChunkVertex(x    , y    , z + 1, 5);
+	return lod > 0 ? MeshMode::Greedy : meshMode;
 }
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides000000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept { return 0; }
-static uint32 generateSides000001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides000010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides000011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides000100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides000101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides000110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides000111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
+// Quad corner U and V offset bits, indexed by the normal. (Keeps clockwise winding)
+static const uint8 quadCornersU[VOXEL_SIDE_COUNT] = { 3, 12, 12, 12, 12, 3 };
+static const uint8 quadCornersV[VOXEL_SIDE_COUNT] = { 6, 6, 9, 6, 6, 6 };
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides001000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePX(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides001001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides001010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides001011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides001100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides001101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static uint32 countTrailingZeros(uint32 value) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides001110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides001111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	GARDEN_ASSERT(value != 0);
+	#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (uint32)index;
+	#else
+	return (uint32)__builtin_ctz(value);
+	#endif
 }
 
-//--------------------------------------------------------------------------------------------------
-static uint32 generateSides010000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePZ(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides010001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides010010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+// Face mask slice axes: X sides (u = z, v = y), Y sides (u = x, v = z), Z sides (u = x, v = y).
+static void sideToChunkPos(uint8 side, uint8 slice,
+	uint8 u, uint8 v, uint8& x, uint8& y, uint8& z) noexcept
 {
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides010011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides010100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides010101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides010110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
+	switch (side >> 1u)
+	{
+	case 0: x = slice; y = v; z = u; break;
+	case 1: x = u; y = slice; z = v; break;
+	default: x = u; y = v; z = slice; break;
+	}
 }
-static uint32 generateSides010111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static Voxel getSliceVoxel(const Chunk* chunk, uint8 side, uint8 slice, uint8 u, uint8 v) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	uint8 x, y, z; sideToChunkPos(side, slice, u, v, x, y, z);
+	return chunk->get(x, y, z);
 }
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides011000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePX(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides011001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides011010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides011011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static void transposeBits64(uint64* rows) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides011100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides011101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides011110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	uint64 mask = 0x00000000FFFFFFFFull;
+	for (uint32 j = 32; j != 0; j >>= 1u, mask ^= (mask << j))
+	{
+		for (uint32 k = 0; k < 64; k = (k + j + 1) & ~j)
+		{
+			auto t = ((rows[k] >> j) ^ rows[k + j]) & mask;
+			rows[k] ^= t << j; rows[k + j] ^= t;
+		}
+	}
 }
-static uint32 generateSides011111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static void getMeshOcclusion(MeshOcclusion& occlusion) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
+	uint64 column[64] = {};
+	for (uint8 y = 0; y < CHUNK_LENGTH + 2; y++)
+	{
+		for (uint8 z = 0; z < CHUNK_LENGTH + 2; z++) column[z] = occlusion.natural.rows[z][y];
+		for (uint8 z = CHUNK_LENGTH + 2; z < 64; z++) column[z] = 0;
+		transposeBits64(column);
+		for (uint8 x = 0; x < CHUNK_LENGTH + 2; x++) occlusion.transposed.rows[x][y] = column[x];
+	}
 }
 
-//--------------------------------------------------------------------------------------------------
-static uint32 generateSides100000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePY(vertices, vertexIndex, x, y, z);
-	return QUAD_VERTEX_COUNT;
-}
-static uint32 generateSides100001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides100010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides100011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+// Returns padded opaque row of u + 1 bits, layer and v are padded slice coordinates.
+static uint64 getOcclusionRow(const MeshOcclusion& occlusion,
+	uint8 side, uint8 layer, uint8 v) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides100100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides100101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides100110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides100111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	switch (side >> 1u)
+	{
+	case 0: return occlusion.transposed.rows[layer][v];
+	case 1: return occlusion.natural.rows[v][layer];
+	default: return occlusion.natural.rows[layer][v];
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides101000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePX(vertices, vertexIndex, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides101001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides101010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides101011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+// Bit sliced corner occlusion of 32 faces at once, two bit planes per corner.
+static void getCornerOcclusion(uint32 side1, uint32 side2,
+	uint32 corner, uint32& low, uint32& high) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	auto bothSides = side1 & side2;
+	low = ~(side1 ^ side2 ^ corner) & ~bothSides;
+	high = ~(bothSides | (side1 & corner) | (side2 & corner));
 }
-static uint32 generateSides101100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides101101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides101110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides101111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+
+// Writes 4 corner occlusion values of the slice faces. ([v][u] corner order, 3 is not occluded)
+static void getSliceOcclusion(const MeshOcclusion& occlusion, uint8 side, uint8 slice,
+	const uint32* rows, uint8 (*sliceOcclusion)[CHUNK_LENGTH]) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
+	auto layer = (uint8)(side & 1u ? slice + 2 : slice);
+	for (uint8 v = 0; v < CHUNK_LENGTH; v++)
+	{
+		auto row = rows[v];
+		if (!row) continue;
+
+		auto prevRow = getOcclusionRow(occlusion, side, layer, v);
+		auto currRow = getOcclusionRow(occlusion, side, layer, v + 1);
+		auto nextRow = getOcclusionRow(occlusion, side, layer, v + 2);
+		auto currNU = (uint32)currRow, currPU = (uint32)(currRow >> 2u);
+		auto prev = (uint32)(prevRow >> 1u), next = (uint32)(nextRow >> 1u);
+		auto prevNU = (uint32)prevRow, prevPU = (uint32)(prevRow >> 2u);
+		auto nextNU = (uint32)nextRow, nextPU = (uint32)(nextRow >> 2u);
+
+		uint32 planes[8];
+		getCornerOcclusion(currNU, prev, prevNU, planes[0], planes[1]);
+		getCornerOcclusion(currPU, prev, prevPU, planes[2], planes[3]);
+		getCornerOcclusion(currNU, next, nextNU, planes[4], planes[5]);
+		getCornerOcclusion(currPU, next, nextPU, planes[6], planes[7]);
+
+		while (row)
+		{
+			auto u = countTrailingZeros(row);
+			row &= row - 1u;
+
+			uint32 value = 0;
+			for (uint8 i = 0; i < 8; i++)
+				value |= ((planes[i] >> u) & 1u) << i;
+			sliceOcclusion[v][u] = (uint8)value;
+		}
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides110000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePZ(vertices, vertexIndex, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	return QUAD_VERTEX_COUNT * 2;
-}
-static uint32 generateSides110001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides110010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides110011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static uint32 countPerFace(const FaceMasks& faceMasks) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides110100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides110101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides110110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
+	auto rows = &faceMasks.sides[0][0][0];
+	uint32 faceCount = 0;
+	for (uint32 i = 0; i < VOXEL_SIDE_COUNT * CHUNK_LENGTH * CHUNK_LENGTH; i++)
+	{
+		#if defined(_MSC_VER)
+		faceCount += __popcnt(rows[i]);
+		#else
+		faceCount += (uint32)__builtin_popcount(rows[i]);
+		#endif
+	}
+	return faceCount;
 }
-static uint32 generateSides110111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static void generatePerFace(const Chunk* chunk, const FaceMasks& faceMasks,
+	const MeshOcclusion& occlusion, ChunkQuad* quads) noexcept
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
+	uint8 sliceOcclusion[CHUNK_LENGTH][CHUNK_LENGTH];
+	for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+	{
+		for (uint8 slice = 0; slice < CHUNK_LENGTH; slice++)
+		{
+			auto rows = faceMasks.sides[side][slice];
+			getSliceOcclusion(occlusion, side, slice, rows, sliceOcclusion);
+
+			for (uint8 v = 0; v < CHUNK_LENGTH; v++)
+			{
+				auto row = rows[v];
+				while (row)
+				{
+					auto u = (uint8)countTrailingZeros(row);
+					row &= row - 1u;
+
+					auto& quad = *quads++;
+					sideToChunkPos(side, slice, u, v, quad.x, quad.y, quad.z);
+					quad.side = side; quad.sizeU = 1; quad.sizeV = 1;
+					quad.voxel = chunk->get(quad.x, quad.y, quad.z);
+					quad.occlusion = sliceOcclusion[v][u];
+				}
+			}
+		}
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
-static uint32 generateSides111000(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSidePX(vertices, vertexIndex, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	return QUAD_VERTEX_COUNT * 3;
-}
-static uint32 generateSides111001(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+// Merged faces should have the same voxel and the same corner occlusion.
+static void generateGreedySlice(vector<ChunkQuad>& quads, const Chunk* chunk,
+	uint32* rows, const uint8 (*sliceOcclusion)[CHUNK_LENGTH], uint8 side, uint8 slice)
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides111010(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides111011(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
-}
-static uint32 generateSides111100(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNY(vertices, vertexIndex, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	return QUAD_VERTEX_COUNT * 4;
-}
-static uint32 generateSides111101(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
-}
-static uint32 generateSides111110(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
-{
-	generateSideNZ(vertices, vertexIndex, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	return QUAD_VERTEX_COUNT * 5;
+	for (uint8 v = 0; v < CHUNK_LENGTH; v++)
+	{
+		auto row = rows[v];
+		while (row)
+		{
+			auto u = (uint8)countTrailingZeros(row);
+			auto voxel = getSliceVoxel(chunk, side, slice, u, v);
+			auto occlusion = sliceOcclusion[v][u];
+
+			uint8 sizeU = 1;
+			while (u + sizeU < CHUNK_LENGTH && (row >> (u + sizeU)) & 1u &&
+				sliceOcclusion[v][u + sizeU] == occlusion &&
+				getSliceVoxel(chunk, side, slice, u + sizeU, v) == voxel) sizeU++;
+			auto runMask = sizeU == CHUNK_LENGTH ? UINT32_MAX : ((1u << sizeU) - 1u) << u;
+			row &= ~runMask;
+
+			uint8 sizeV = 1;
+			while (v + sizeV < CHUNK_LENGTH && (rows[v + sizeV] & runMask) == runMask)
+			{
+				auto isSame = true;
+				for (uint8 i = u; i < u + sizeU; i++)
+				{
+					if (sliceOcclusion[v + sizeV][i] == occlusion &&
+						getSliceVoxel(chunk, side, slice, i, v + sizeV) == voxel) continue;
+					isSame = false; break;
+				}
+				if (!isSame) break;
+				rows[v + sizeV] &= ~runMask;
+				sizeV++;
+			}
+
+			ChunkQuad quad;
+			sideToChunkPos(side, slice, u, v, quad.x, quad.y, quad.z);
+			quad.side = side; quad.sizeU = sizeU; quad.sizeV = sizeV;
+			quad.voxel = voxel;
+			quad.occlusion = occlusion;
+			quads.push_back(quad);
+		}
+	}
 }
-static uint32 generateSides111111(ChunkVertex* vertices,
-	uint32 vertexIndex, uint8 x, uint8 y, uint8 z) noexcept
+static void generateGreedy(const Chunk* chunk, FaceMasks& faceMasks,
+	const MeshOcclusion& occlusion, vector<ChunkQuad>& quads)
 {
-	generateSideNX(vertices, vertexIndex, x, y, z);
-	generateSideNZ(vertices, vertexIndex + QUAD_VERTEX_COUNT, x, y, z);
-	generateSideNY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 2, x, y, z);
-	generateSidePX(vertices, vertexIndex + QUAD_VERTEX_COUNT * 3, x, y, z);
-	generateSidePZ(vertices, vertexIndex + QUAD_VERTEX_COUNT * 4, x, y, z);
-	generateSidePY(vertices, vertexIndex + QUAD_VERTEX_COUNT * 5, x, y, z);
-	return QUAD_VERTEX_COUNT * 6;
+	uint8 sliceOcclusion[CHUNK_LENGTH][CHUNK_LENGTH];
+	for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+	{
+		for (uint8 slice = 0; slice < CHUNK_LENGTH; slice++)
+		{
+			auto rows = faceMasks.sides[side][slice];
+			getSliceOcclusion(occlusion, side, slice, rows, sliceOcclusion);
+			generateGreedySlice(quads, chunk, rows, sliceOcclusion, side, slice);
+		}
+	}
 }
 
-//--------------------------------------------------------------------------------------------------
-static uint32(*generateSides[64])(ChunkVertex*, uint32, uint8, uint8, uint8) = // 2 ^ 6
-{
-	generateSides000000, generateSides000001, generateSides000010, generateSides000011,
-	generateSides000100, generateSides000101, generateSides000110, generateSides000111,
-	generateSides001000, generateSides001001, generateSides001010, generateSides001011,
-	generateSides001100, generateSides001101, generateSides001110, generateSides001111,
-	generateSides010000, generateSides010001, generateSides010010, generateSides010011,
-	generateSides010100, generateSides010101, generateSides010110, generateSides010111,
-	generateSides011000, generateSides011001, generateSides011010, generateSides011011,
-	generateSides011100, generateSides011101, generateSides011110, generateSides011111,
-	generateSides100000, generateSides100001, generateSides100010, generateSides100011,
-	generateSides100100, generateSides100101, generateSides100110, generateSides100111,
-	generateSides101000, generateSides101001, generateSides101010, generateSides101011,
-	generateSides101100, generateSides101101, generateSides101110, generateSides101111,
-	generateSides110000, generateSides110001, generateSides110010, generateSides110011,
-	generateSides110100, generateSides110101, generateSides110110, generateSides110111,
-	generateSides111000, generateSides111001, generateSides111010, generateSides111011,
-	generateSides111100, generateSides111101, generateSides111110, generateSides111111
-};
-
 //--------------------------------------------------------------------------------------------------
 static ID<Buffer> createIndexBuffer(GraphicsSystem* graphicsSystem, uint32 indexCount)
 {
@@ -676,98 +339,231 @@ void MesherSystem::initialize()
 
 	threadSystem = manager->get<ThreadSystem>();
 	auto threadCount = threadSystem->getBackgroundPool().getThreadCount();
-	buffers.resize(threadCount);
-
-	for (uint32 i = 0; i < threadCount; i++)
-		buffers[i].resize(CHUNK_SIZE * VOXEL_VERTEX_COUNT);
+	// Quad buffers grow on demand up to the biggest mesh generated by the thread.
+	quadBuffers.resize(threadCount + 1);
 
 	auto worldSystem = manager->get<WorldSystem>();
 	registry = &worldSystem->getRegistry();
 
 	indexBufferSize = VOXEL_INDEX_COUNT * CHUNK_LENGTH * CHUNK_LENGTH;
 	indexBuffer = createIndexBuffer(graphicsSystem, indexBufferSize);
+
+	// Ring memory is reused after the frames in flight are finished.
+	stagingBuffer = graphicsSystem->createBuffer(Buffer::Bind::TransferSrc,
+		Buffer::Access::SequentialWrite, stagingRingSize,
+		Buffer::Usage::Auto, Buffer::Strategy::Speed);
+	SET_RESOURCE_DEBUG_NAME(graphicsSystem, stagingBuffer, "buffer.staging.chunks");
+	stagingMap = graphicsSystem->get(stagingBuffer)->getMap();
+	stagingRing = StagingRing(stagingRingSize, graphicsSystem->getSwapchainSize() + 1, threadCount);
+	freeAllocations.resize(graphicsSystem->getSwapchainSize() + 1);
 }
 
 //--------------------------------------------------------------------------------------------------
-void MesherSystem::generate(const ThreadPool::Task& task)
+uint32 MesherSystem::generateQuads(const SliceCluster& cluster,
+	const Registry& registry, MeshMode meshMode, vector<ChunkQuad>& quads)
 {
-	auto cluster = (MeshCluster*)task.getArgument();
-	auto system = cluster->system;
-	auto registry = system->registry;
-	const auto voxels = cluster->c->getVoxels();
-	auto buffer = system->buffers[task.getThreadIndex()].data();
-	uint32 index = 0, vertexCount = 0;
+	quads.clear();
+	if (cluster.c.isUniform() && registry.isTransparent(cluster.c.getUniformVoxel()))
+		return 0;
+
+	FaceMasks faceMasks; MeshOcclusion occlusion;
+	cluster.getFaceMasks(registry, faceMasks, &occlusion.natural);
+	getMeshOcclusion(occlusion);
+
+	if (meshMode == MeshMode::Greedy)
+	{
+		generateGreedy(&cluster.c, faceMasks, occlusion, quads);
+	}
+	else
+	{
+		quads.resize(countPerFace(faceMasks));
+		generatePerFace(&cluster.c, faceMasks, occlusion, quads.data());
+	}
+	return (uint32)quads.size();
+}
+void MesherSystem::writeVertices(const ChunkQuad* quads,
+	uint32 quadCount, ChunkVertex* vertices) noexcept
+{
+	GARDEN_ASSERT(quads || quadCount == 0);
+	GARDEN_ASSERT(vertices || quadCount == 0);
 
-	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	for (uint32 i = 0; i < quadCount; i++)
 	{
-		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		auto& quad = quads[i];
+		auto cornersU = quadCornersU[quad.side], cornersV = quadCornersV[quad.side];
+		auto plane = (uint8)(quad.side & 1u);
+
+		for (uint8 j = 0; j < QUAD_VERTEX_COUNT; j++)
 		{
-			for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+			auto cornerU = (uint8)((cornersU >> j) & 1u), cornerV = (uint8)((cornersV >> j) & 1u);
+			auto offsetU = (uint8)(cornerU * quad.sizeU), offsetV = (uint8)(cornerV * quad.sizeV);
+			auto occlusion = (uint8)((quad.occlusion >> ((cornerV * 2u + cornerU) * 2u)) & 3u);
+
+			uint8 x, y, z;
+			switch (quad.side >> 1u)
 			{
-				auto voxel = voxels[index++];
-				auto mask = cluster->getNearMask(x, y, z, *registry);
-				vertexCount += generateSides[mask](buffer, vertexCount, x, y, z);
+			case 0: x = quad.x + plane; y = quad.y + offsetV; z = quad.z + offsetU; break;
+			case 1: x = quad.x + offsetU; y = quad.y + plane; z = quad.z + offsetV; break;
+			default: x = quad.x + offsetU; y = quad.y + offsetV; z = quad.z + plane; break;
 			}
+			vertices[i * QUAD_VERTEX_COUNT + j] = ChunkVertex(x, y, z, quad.side, occlusion);
 		}
 	}
+}
 
-	system->meshMutex.lock();
-	if (vertexCount > 0)
+void MesherSystem::writeFaces(const ChunkQuad* quads, uint32 quadCount, ChunkFace* faces) noexcept
+{
+	GARDEN_ASSERT(quads || quadCount == 0);
+	GARDEN_ASSERT(faces || quadCount == 0);
+
+	for (uint32 i = 0; i < quadCount; i++)
+		faces[i] = ChunkFace(quads[i]);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Mesh data is written straight into the staging ring, or into the mesh if it is full.
+MesherSystem::ChunkMesh MesherSystem::createChunkMesh(const ChunkQuad* quads,
+	uint32 quadCount, uint32 structureID, const int3& position)
+{
+	ChunkMesh mesh;
+	mesh.structureID = structureID;
+	mesh.position = position;
+	mesh.quadCount = quadCount;
+	if (quadCount == 0) return mesh;
+
+	for (uint32 i = 0; i < quadCount; i++)
 	{
-		auto bufferByteSize = vertexCount * sizeof(ChunkVertex);
+		GARDEN_ASSERT(i == 0 || quads[i - 1].side <= quads[i].side);
+		mesh.sideQuadCounts[quads[i].side]++;
+	}
 
-		ChunkMesh mesh =
-		{
-			BufferExt::create(Buffer::Bind::TransferDst | Buffer::Bind::Vertex,
-				Buffer::Access::None, Buffer::Usage::PreferGPU,
-				Buffer::Strategy::Size, bufferByteSize, 0),
-			BufferExt::create(Buffer::Bind::TransferSrc, Buffer::Access::SequentialWrite,
-				Buffer::Usage::Auto, Buffer::Strategy::Speed, bufferByteSize, 0),
-			cluster->c->getStructureID(),
-			cluster->c->position
-		};
-
-		auto stagingMap = mesh.stagingBuffer.getMap();
-		memcpy(stagingMap, buffer, bufferByteSize);
-		mesh.stagingBuffer.flush();
-		system->meshes.push_back(std::move(mesh));
+	auto isFaceFormat = meshFormat == MeshFormat::Face;
+	mesh.byteSize = isFaceFormat ? quadCount * sizeof(ChunkFace) :
+		quadCount * QUAD_VERTEX_COUNT * sizeof(ChunkVertex);
+	mesh.stagingOffset = stagingRing.allocate(mesh.byteSize);
+
+	uint8* data;
+	if (mesh.stagingOffset != StagingRing::invalidOffset)
+	{
+		data = stagingMap + mesh.stagingOffset;
 	}
 	else
 	{
-		ChunkMesh mesh =
-		{
-			BufferExt::create((Buffer::Bind)0, (Buffer::Access)0,
-				(Buffer::Usage)0, (Buffer::Strategy)0, 0),
-			BufferExt::create((Buffer::Bind)0, (Buffer::Access)0,
-				(Buffer::Usage)0, (Buffer::Strategy)0, 0),
-			cluster->c->getStructureID(),
-			cluster->c->position
-		};
-
-		system->meshes.push_back(std::move(mesh));
+		mesh.data.resize(mesh.byteSize);
+		data = mesh.data.data();
 	}
+
+	if (isFaceFormat) writeFaces(quads, quadCount, (ChunkFace*)data);
+	else writeVertices(quads, quadCount, (ChunkVertex*)data);
+	return mesh;
+}
+// Moves mesh data to the staging ring, returns false if it is still full.
+bool MesherSystem::tryStageMesh(ChunkMesh& mesh)
+{
+	if (mesh.byteSize == 0 || mesh.stagingOffset != StagingRing::invalidOffset) return true;
+	mesh.stagingOffset = stagingRing.allocate(mesh.byteSize);
+	if (mesh.stagingOffset == StagingRing::invalidOffset) return false;
+	memcpy(stagingMap + mesh.stagingOffset, mesh.data.data(), mesh.byteSize);
+	mesh.data = {};
+	return true;
+}
+static uint32 getMeshIndexCount(const MesherSystem::ChunkMesh& mesh) noexcept
+{
+	return mesh.quadCount * QUAD_INDEX_COUNT;
+}
+
+void MesherSystem::generate(const ThreadPool::Task& task)
+{
+	auto cluster = (MeshCluster*)task.getArgument();
+	auto system = cluster->system;
+
+	// Queued job of the evicted or remeshed chunk is dropped without meshing it.
+	if (cluster->job.isCancelled())
+	{
+		system->meshMutex.lock();
+		system->cancelledCount++;
+		system->meshMutex.unlock();
+		delete cluster;
+		return;
+	}
+
+	// Packed center is unpacked here, main thread only pins the snapshots.
+	auto& sliceCluster = cluster->slices;
+	auto lod = sliceCluster.c.lod;
+	if (lod > 0)
+	{
+		// Center blocks are read before they are filled, so the center is downsampled in place.
+		auto nearChunks = cluster->nearChunks;
+		auto nearCluster = Cluster(&sliceCluster.c, &nearChunks[0], &nearChunks[1],
+			&nearChunks[2], &nearChunks[3], &nearChunks[4], &nearChunks[5]);
+		sliceCluster.downsample(nearCluster, *system->registry, lod, sliceCluster.c.lodSeams);
+	}
+	else
+	{
+		sliceCluster.c.unpack();
+	}
+
+	auto& quads = system->quadBuffers[task.getThreadIndex()];
+	auto quadCount = generateQuads(sliceCluster, *system->registry, cluster->meshMode, quads);
+	system->cacheMutex.lock();
+	system->meshCache.add(cluster->hash, quads.data(), quadCount);
+	system->cacheMutex.unlock();
+
+	// Cached quads are still useful, but the staging memory is not spent on them.
+	if (cluster->job.isCancelled())
+	{
+		system->meshMutex.lock();
+		system->cancelledCount++;
+		system->meshMutex.unlock();
+		delete cluster;
+		return;
+	}
+
+	system->stagingRing.beginWrite(task.getThreadIndex());
+	auto mesh = system->createChunkMesh(quads.data(),
+		quadCount, sliceCluster.c.getStructureID(), sliceCluster.c.position);
+	mesh.job = cluster->job;
+	system->meshMutex.lock();
+	system->meshes.push_back(std::move(mesh));
 	system->meshMutex.unlock();
+	system->stagingRing.endWrite(task.getThreadIndex());
 
-	delete cluster->c;
 	delete cluster;
 }
 
 //--------------------------------------------------------------------------------------------------
-void MesherSystem::generateMesh(const Cluster& cluster)
+void MesherSystem::generateMesh(const Cluster& cluster, const JobHandle& job)
 {
 	GARDEN_ASSERT(cluster.isMeshingReady());
 
-	auto chunks = new Chunk[CHUNK_CLUSTER_SIZE];
-	chunks[0] = *cluster.c;
-	chunks[1] = *cluster.nx;
-	chunks[2] = *cluster.px;
-	chunks[3] = *cluster.ny;
-	chunks[4] = *cluster.py;
-	chunks[5] = *cluster.nz;
-	chunks[6] = *cluster.pz;
+	pendingCount++;
+
+	// Key covers decoded source voxels, mesh settings are mixed into the seed.
+	auto lod = cluster.c->lod;
+	auto lodMeshMode = getLODMeshMode(meshMode, lod);
+	auto hash = cluster.getContentHash(hashValue((uint64)lodMeshMode |
+		((uint64)lod << 8u) | ((uint64)cluster.c->lodSeams << 16u)));
 
-	auto meshCluster = new MeshCluster(this, &chunks[0],
-		&chunks[1], &chunks[2], &chunks[3], &chunks[4], &chunks[5], &chunks[6]);
+	// Revisited or repeated content reuses cached quads without scheduling a task.
+	cacheMutex.lock();
+	auto cachedQuads = meshCache.tryGet(hash);
+	if (cachedQuads)
+	{
+		auto mesh = createChunkMesh(cachedQuads->data(), (uint32)cachedQuads->size(),
+			cluster.c->getStructureID(), cluster.c->position);
+		cacheMutex.unlock();
+		mesh.job = job;
+
+		meshMutex.lock();
+		meshes.push_back(std::move(mesh));
+		meshMutex.unlock();
+		return;
+	}
+	cacheMutex.unlock();
+
+	auto meshCluster = new MeshCluster(this, cluster, lodMeshMode);
+	meshCluster->job = job;
+	meshCluster->hash = hash;
 
 	auto& threadPool = threadSystem->getBackgroundPool();
 	threadPool.addTask(ThreadPool::Task(generate, meshCluster));
@@ -775,52 +571,198 @@ void MesherSystem::generateMesh(const Cluster& cluster)
 void MesherSystem::flush(std::function<void(ChunkMesh&, uint32)> onMesh)
 {
 	GARDEN_ASSERT(onMesh);
-	meshMutex.lock();
+	stagingRing.beginFrame();
 
-	uint32 biggestIndexCount = 0;
-	for (auto& mesh : meshes)
+	// Heap memory is reused after the frames in flight are finished.
+	freeFrameIndex = (freeFrameIndex + 1) % (uint32)freeAllocations.size();
+	for (const auto& allocation : freeAllocations[freeFrameIndex])
 	{
-		auto binarySize = mesh.stagingBuffer.getBinarySize();
-		auto indexCount = (uint32)((binarySize / (sizeof(ChunkVertex) * 4)) * 6);
-		biggestIndexCount = std::max(biggestIndexCount, indexCount);
-		onMesh(mesh, indexCount);
-
-		GraphicsAPI::isRunning = false;
-		BufferExt::destroy(mesh.stagingBuffer);
-		BufferExt::destroy(mesh.vertexBuffer);
-		GraphicsAPI::isRunning = true;
+		OffsetAllocator::Allocation pageAllocation;
+		pageAllocation.offset = allocation.offset;
+		pageAllocation.node = allocation.node;
+		heapPages[allocation.page].allocator.free(pageAllocation);
 	}
+	freeAllocations[freeFrameIndex].clear();
 
+	meshMutex.lock();
+	GARDEN_ASSERT(pendingCount >= meshes.size() + cancelledCount);
+	pendingCount -= (uint32)meshes.size() + cancelledCount;
+	cancelledCount = 0;
+	for (auto& mesh : meshes)
+	{
+		// Cancelled meshes are not uploaded, their ring memory is released with the frame.
+		if (!mesh.job.isCancelled()) pendingMeshes.push_back(std::move(mesh));
+	}
 	meshes.clear();
 	meshMutex.unlock();
 
-	if (biggestIndexCount > indexBufferSize)
+	// Meshes with worker allocations are always uploaded this frame, so that the ring
+	// tail never passes them. Only fallback meshes are deferred when it is still full.
+	psize deferredCount = 0;
+	for (psize i = 0; i < pendingMeshes.size(); i++)
 	{
-		graphicsSystem->destroy(indexBuffer);
-		indexBuffer = createIndexBuffer(graphicsSystem, biggestIndexCount);
-		indexBufferSize = biggestIndexCount;
+		auto& mesh = pendingMeshes[i];
+		if (mesh.job.isCancelled()) continue;
+		if (tryStageMesh(mesh)) stagedMeshes.push_back(std::move(mesh));
+		else if (i != deferredCount) pendingMeshes[deferredCount++] = std::move(mesh);
+		else deferredCount++;
 	}
+	pendingMeshes.resize(deferredCount);
+
+	if (!stagedMeshes.empty())
+	{
+		// Whole ring is flushed once per frame instead of per chunk.
+		graphicsSystem->get(stagingBuffer)->flush(stagingRing.getCapacity());
+
+		uint32 biggestIndexCount = 0;
+		for (auto& mesh : stagedMeshes)
+		{
+			auto indexCount = getMeshIndexCount(mesh);
+			biggestIndexCount = std::max(biggestIndexCount, indexCount);
+			onMesh(mesh, indexCount);
+
+			// Older deferred mesh of the same chunk shouldn't overwrite the newer one.
+			for (psize i = 0; i < pendingMeshes.size(); i++)
+			{
+				auto& pending = pendingMeshes[i];
+				if (pending.structureID != mesh.structureID || pending.position != mesh.position)
+					continue;
+				pendingMeshes.erase(pendingMeshes.begin() + i); i--;
+			}
+		}
+
+		stagedMeshes.clear();
+		reserveIndexBuffer(biggestIndexCount);
+		recordHeapCopies(stagingBuffer);
+	}
+
+	stagingRing.endFrame();
+}
+void MesherSystem::generateMeshNow(const Cluster& cluster,
+	std::function<void(ChunkMesh&, uint32)> onMesh)
+{
+	GARDEN_ASSERT(cluster.isMeshingReady());
+	GARDEN_ASSERT(onMesh);
+
+	// Main thread has its own quad buffer after the background pool ones.
+	auto sliceCluster = SliceCluster(cluster);
+	if (cluster.c->lod > 0)
+		sliceCluster.downsample(cluster, *registry, cluster.c->lod, cluster.c->lodSeams);
+	auto& quads = quadBuffers.back();
+	auto quadCount = generateQuads(sliceCluster, *registry,
+		getLODMeshMode(meshMode, cluster.c->lod), quads);
+
+	auto mesh = createChunkMesh(quads.data(), quadCount,
+		cluster.c->getStructureID(), cluster.c->position);
+	auto indexCount = getMeshIndexCount(mesh);
+	reserveIndexBuffer(indexCount);
+
+	if (tryStageMesh(mesh))
+	{
+		graphicsSystem->get(stagingBuffer)->flush(stagingRing.getCapacity());
+		onMesh(mesh, indexCount);
+		recordHeapCopies(stagingBuffer);
+		return;
+	}
+
+	// Ring is full, edited chunk is uploaded with a standalone staging buffer instead.
+	auto buffer = graphicsSystem->createBuffer(Buffer::Bind::TransferSrc,
+		Buffer::Access::SequentialWrite, mesh.byteSize,
+		Buffer::Usage::Auto, Buffer::Strategy::Speed);
+	SET_RESOURCE_DEBUG_NAME(graphicsSystem, buffer, "buffer.staging.chunk");
+	auto bufferView = graphicsSystem->get(buffer);
+	memcpy(bufferView->getMap(), mesh.data.data(), mesh.byteSize);
+	bufferView->flush(mesh.byteSize);
+	mesh.stagingOffset = 0;
+	mesh.data = {};
+
+	onMesh(mesh, indexCount);
+	recordHeapCopies(buffer);
+	graphicsSystem->destroy(buffer); // Destroyed after the frames in flight are finished.
+}
+void MesherSystem::reserveIndexBuffer(uint32 indexCount)
+{
+	if (indexCount <= indexBufferSize) return;
+	graphicsSystem->destroy(indexBuffer);
+	indexBuffer = createIndexBuffer(graphicsSystem, indexCount);
+	indexBufferSize = indexCount;
 }
 
 //--------------------------------------------------------------------------------------------------
-ID<Buffer> MesherSystem::getVertexBuffer(ChunkMesh& chunkMesh)
+ChunkAllocation MesherSystem::allocateMesh(const ChunkMesh& chunkMesh)
+{
+	GARDEN_ASSERT(chunkMesh.byteSize > 0);
+	GARDEN_ASSERT(chunkMesh.stagingOffset != StagingRing::invalidOffset);
+
+	ChunkAllocation allocation;
+	OffsetAllocator::Allocation pageAllocation;
+	for (uint32 i = 0; i < (uint32)heapPages.size(); i++)
+	{
+		pageAllocation = heapPages[i].allocator.allocate(chunkMesh.byteSize);
+		if (!pageAllocation.isValid()) continue;
+		allocation.page = i;
+		break;
+	}
+
+	if (!allocation.isValid())
+	{
+		// TODO: measure if default memory strategy is better
+		auto pageSize = std::max(heapPageSize, chunkMesh.byteSize);
+		auto bufferBind = meshFormat == MeshFormat::Face ? Buffer::Bind::Storage : Buffer::Bind::Vertex;
+		HeapPage heapPage;
+		heapPage.buffer = graphicsSystem->createBuffer(Buffer::Bind::TransferDst | bufferBind,
+			Buffer::Access::None, pageSize, Buffer::Usage::PreferGPU, Buffer::Strategy::Size);
+		SET_RESOURCE_DEBUG_NAME(graphicsSystem, heapPage.buffer,
+			"buffer.vertex.chunkHeap" + to_string(heapPages.size()));
+		heapPage.allocator.reset(pageSize);
+		pageAllocation = heapPage.allocator.allocate(chunkMesh.byteSize);
+		GARDEN_ASSERT(pageAllocation.isValid());
+		allocation.page = (uint32)heapPages.size();
+		heapPages.push_back(std::move(heapPage));
+	}
+
+	allocation.offset = pageAllocation.offset;
+	allocation.node = pageAllocation.node;
+	allocation.byteSize = chunkMesh.byteSize;
+
+	Buffer::CopyRegion copyRegion;
+	copyRegion.size = chunkMesh.byteSize;
+	copyRegion.srcOffset = chunkMesh.stagingOffset;
+	copyRegion.dstOffset = allocation.offset;
+	heapPages[allocation.page].copyRegions.push_back(copyRegion);
+	return allocation;
+}
+void MesherSystem::freeMesh(ChunkAllocation& allocation)
+{
+	if (!allocation.isValid()) return;
+	GARDEN_ASSERT(allocation.page < heapPages.size());
+	freeAllocations[freeFrameIndex].push_back(allocation);
+	allocation = {};
+}
+
+// All chunk uploads of the frame are recorded with one copy command per heap page.
+void MesherSystem::recordHeapCopies(ID<Buffer> srcBuffer)
 {
-	// TODO: measure if default memory strategy is better
-	GARDEN_ASSERT(chunkMesh.vertexBuffer.getBinarySize() > 0);
-	auto vertexBuffer = GraphicsAPI::bufferPool.create(
-		Buffer::Bind::TransferDst | Buffer::Bind::Vertex, Buffer::Access::None,
-		Buffer::Usage::PreferGPU, Buffer::Strategy::Size, 0);
-	auto stagingBuffer = GraphicsAPI::bufferPool.create(Buffer::Bind::TransferSrc,
-		Buffer::Access::SequentialWrite, Buffer::Usage::Auto, Buffer::Strategy::Speed, 0);
-	auto vertexView = GraphicsAPI::bufferPool.get(vertexBuffer);
-	auto stagingView = GraphicsAPI::bufferPool.get(stagingBuffer);
-	BufferExt::moveInternalObjects(chunkMesh.vertexBuffer, **vertexView);
-	BufferExt::moveInternalObjects(chunkMesh.stagingBuffer, **stagingView);
-	SET_RESOURCE_DEBUG_NAME(graphicsSystem, vertexBuffer,
-		"buffer.vertex.chunk." + chunkMesh.position.toString());
-	SET_RESOURCE_DEBUG_NAME(graphicsSystem, stagingBuffer,
-		"buffer.staging.chunk." + chunkMesh.position.toString());
-	Buffer::copy(stagingBuffer, vertexBuffer);
-	GraphicsAPI::bufferPool.destroy(stagingBuffer);
-	return vertexBuffer;
-}
\ No newline at end of file
+	for (auto& heapPage : heapPages)
+	{
+		if (heapPage.copyRegions.empty()) continue;
+		Buffer::copy(srcBuffer, heapPage.buffer,
+			heapPage.copyRegions.data(), (uint32)heapPage.copyRegions.size());
+		heapPage.copyRegions.clear();
+	}
+}
+
+OffsetAllocator::Stats MesherSystem::getHeapStats() const noexcept
+{
+	OffsetAllocator::Stats heapStats;
+	for (auto& heapPage : heapPages)
+	{
+		auto pageStats = heapPage.allocator.getStats();
+		heapStats.totalSize += pageStats.totalSize;
+		heapStats.freeSize += pageStats.freeSize;
+		heapStats.largestFreeRegion = std::max(heapStats.largestFreeRegion, pageStats.largestFreeRegion);
+		heapStats.freeRegionCount += pageStats.freeRegionCount;
+		heapStats.allocationCount += pageStats.allocationCount;
+	}
+	return heapStats;
+}
@@ -111,6 +111,18 @@ void VoxGeoRenderSystem::prepareDraw(const float4x4& viewProj,
 	framebufferSize = framebufferView->getSize();
 	indexBuffer = mesherSystem->getIndexBuffer();
 	indexBufferType = mesherSystem->getIndexBufferType();
+	cameraPosition = getManager()->get<TransformComponent>(graphicsSystem->camera)->position;
+
+	// Heap pages are never destroyed, so only sets for the new pages are created.
+	if (mesherSystem->meshFormat == MeshFormat::Face)
+	{
+		auto heapPageCount = mesherSystem->getHeapPageCount();
+		while (faceDescriptorSets.size() < heapPageCount)
+		{
+			auto heapBuffer = mesherSystem->getHeapBuffer((uint32)faceDescriptorSets.size());
+			faceDescriptorSets.push_back(createFaceDescriptorSet(heapBuffer));
+		}
+	}
 }
 void VoxGeoRenderSystem::beginDraw(int32 taskIndex)
 {
@@ -124,10 +136,12 @@ void VoxGeoRenderSystem::draw(MeshRenderComponent* meshRenderComponent,
 	const float4x4& viewProj, const float4x4& model, uint32 drawIndex, int32 taskIndex)
 {
 	auto voxGeoComponent = (VoxGeoRenderComponent*)meshRenderComponent;
-	if (!voxGeoComponent->vertexBuffer) return;
+	const auto& allocation = voxGeoComponent->allocation;
+	if (!allocation.isValid()) return;
 
-	auto vertexBufferView = getGraphicsSystem()->get(voxGeoComponent->vertexBuffer);
-	if (!vertexBufferView->isReady()) return;
+	auto heapBuffer = mesherSystem->getHeapBuffer(allocation.page);
+	auto heapBufferView = getGraphicsSystem()->get(heapBuffer);
+	if (!heapBufferView->isReady()) return;
 
 	auto& instance = instanceMap[drawIndex];
 	instance.mvp = viewProj * model;
@@ -136,8 +150,55 @@ void VoxGeoRenderSystem::draw(MeshRenderComponent* meshRenderComponent,
 	pushConstants->instanceIndex = drawIndex;
 	pipelineView->pushConstantsAsync(taskIndex);
 
-	pipelineView->drawIndexedAsync(taskIndex, voxGeoComponent->vertexBuffer,
-		indexBuffer, indexBufferType, voxGeoComponent->indexCount);
+	// Chunks share heap page buffers, mesh is addressed by the vertex offset.
+	auto vertexOffset = mesherSystem->getVertexOffset(allocation);
+	auto isFaceFormat = mesherSystem->meshFormat == MeshFormat::Face;
+	// Faces are pulled by the vertex index, 4 vertices per face.
+	if (isFaceFormat)
+		pipelineView->bindDescriptorSetAsync(faceDescriptorSets[allocation.page], 0, taskIndex);
+	auto vertexBuffer = isFaceFormat ? ID<Buffer>() : heapBuffer;
+
+	if (!useSideCulling)
+	{
+		pipelineView->drawIndexedAsync(taskIndex, vertexBuffer, indexBuffer,
+			indexBufferType, voxGeoComponent->indexCount, 1, 0, vertexOffset);
+		return;
+	}
+
+	// Side faces are visible only from the front of their planes. (NX, PX, NY, PY, NZ, PZ)
+	auto chunkMin = (float3)(voxGeoComponent->chunkPosition * CHUNK_LENGTH);
+	auto chunkMax = chunkMin + (float)CHUNK_LENGTH;
+	bool isSideVisible[VOXEL_SIDE_COUNT] =
+	{
+		cameraPosition.x < chunkMax.x, cameraPosition.x > chunkMin.x,
+		cameraPosition.y < chunkMax.y, cameraPosition.y > chunkMin.y,
+		cameraPosition.z < chunkMax.z, cameraPosition.z > chunkMin.z,
+	};
+
+	// Adjacent visible side ranges are merged into one draw.
+	uint32 quadOffset = 0, drawOffset = 0, drawCount = 0;
+	for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+	{
+		auto quadCount = voxGeoComponent->sideQuadCounts[side];
+		if (isSideVisible[side])
+		{
+			if (drawCount == 0) drawOffset = quadOffset;
+			drawCount += quadCount;
+		}
+		else if (drawCount > 0)
+		{
+			pipelineView->drawIndexedAsync(taskIndex, vertexBuffer, indexBuffer, indexBufferType,
+				drawCount * QUAD_INDEX_COUNT, 1, drawOffset * QUAD_INDEX_COUNT, vertexOffset);
+			drawCount = 0;
+		}
+		quadOffset += quadCount;
+	}
+
+	if (drawCount > 0)
+	{
+		pipelineView->drawIndexedAsync(taskIndex, vertexBuffer, indexBuffer, indexBufferType,
+			drawCount * QUAD_INDEX_COUNT, 1, drawOffset * QUAD_INDEX_COUNT, vertexOffset);
+	}
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -180,6 +241,17 @@ ID<GraphicsPipeline> VoxGeoRenderSystem::getPipeline()
 	if (!pipeline) pipeline = createPipeline();
 	return pipeline;
 }
+ID<DescriptorSet> VoxGeoRenderSystem::createFaceDescriptorSet(ID<Buffer> faceBuffer)
+{
+	GARDEN_ASSERT(faceBuffer);
+	GARDEN_ASSERT(mesherSystem->meshFormat == MeshFormat::Face);
+	auto graphicsSystem = getGraphicsSystem();
+	map<string, DescriptorSet::Uniform> uniforms =
+	{ { "faces", DescriptorSet::Uniform(faceBuffer) } };
+	auto descriptorSet = graphicsSystem->createDescriptorSet(pipeline, std::move(uniforms), 1);
+	SET_RESOURCE_DEBUG_NAME(graphicsSystem, descriptorSet, "descriptorSet.geometry.faces");
+	return descriptorSet;
+}
 
 //--------------------------------------------------------------------------------------------------
 void VoxGeoShadRenderSystem::initialize()
@@ -190,6 +262,8 @@ void VoxGeoShadRenderSystem::initialize()
 
 bool VoxGeoShadRenderSystem::isDrawReady()
 {
+	// Shadow pass has only the vertex pipeline, face heap pages are not vertex buffers.
+	if (mesherSystem->meshFormat != MeshFormat::Vertex) return false;
 	auto pipelineView = getGraphicsSystem()->get(pipeline);
 	return pipelineView->isReady();
 }
@@ -213,20 +287,23 @@ void VoxGeoShadRenderSystem::beginDraw(int32 taskIndex)
 void VoxGeoShadRenderSystem::draw(MeshRenderComponent* meshRenderComponent,
 	const float4x4& viewProj, const float4x4& model, uint32 drawIndex, int32 taskIndex)
 {
+	GARDEN_ASSERT(mesherSystem->meshFormat == MeshFormat::Vertex);
 	auto voxGeoShadComponent = (VoxGeoShadRenderComponent*)meshRenderComponent;
-	if (!voxGeoShadComponent->vertexBuffer) return;
+	const auto& allocation = voxGeoShadComponent->allocation;
+	if (!allocation.isValid()) return;
 
 	auto graphicsSystem = getGraphicsSystem();
-	auto vertexBufferView = graphicsSystem->get(voxGeoShadComponent->vertexBuffer);
-	if (!vertexBufferView->isReady()) return;
+	auto heapBuffer = mesherSystem->getHeapBuffer(allocation.page);
+	auto heapBufferView = graphicsSystem->get(heapBuffer);
+	if (!heapBufferView->isReady()) return;
 
 	auto& cameraConstants = graphicsSystem->getCurrentCameraConstants();
 	auto pushConstants = pipelineView->getPushConstantsAsync<VoxGeoShadPC>(taskIndex);
 	pushConstants->mvp = viewProj * model;
 	pipelineView->pushConstantsAsync(taskIndex);
 
-	pipelineView->drawIndexedAsync(taskIndex, voxGeoShadComponent->vertexBuffer,
-		indexBuffer, indexBufferType, voxGeoShadComponent->indexCount);
+	pipelineView->drawIndexedAsync(taskIndex, heapBuffer, indexBuffer, indexBufferType,
+		voxGeoShadComponent->indexCount, 1, 0, mesherSystem->getVertexOffset(allocation));
 }
 
 ID<GraphicsPipeline> VoxGeoShadRenderSystem::getPipeline()
@@ -47,7 +47,7 @@ ID<Component> OpaqVoxRenderSystem::createComponent(ID<Entity> entity)
 void OpaqVoxRenderSystem::destroyComponent(ID<Component> instance)
 {
 	auto component = components.get(ID<OpaqVoxRenderComponent>(instance));
-	getGraphicsSystem()->destroy(component->vertexBuffer);
+	mesherSystem->freeMesh(component->allocation);
 	components.destroy(ID<OpaqVoxRenderComponent>(instance));
 }
 View<Component> OpaqVoxRenderSystem::getComponent(ID<Component> instance)
@@ -73,8 +73,11 @@ psize OpaqVoxRenderSystem::getMeshComponentSize() const
 ID<GraphicsPipeline> OpaqVoxRenderSystem::createPipeline()
 {
 	auto deferredSystem = getManager()->get<DeferredRenderSystem>();
+	auto meshFormat = getManager()->get<MesherSystem>()->meshFormat;
+	auto path = meshFormat == MeshFormat::Face ?
+		"geometry/opaq-vox-face" : "geometry/opaq-vox";
 	return ResourceSystem::getInstance()->loadGraphicsPipeline(
-		"geometry/opaq-vox", deferredSystem->getGFramebuffer(), true, true);
+		path, deferredSystem->getGFramebuffer(), true, true);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -96,7 +99,7 @@ ID<Component> OpaqVoxShadRenderSystem::createComponent(ID<Entity> entity)
 void OpaqVoxShadRenderSystem::destroyComponent(ID<Component> instance)
 {
 	auto component = components.get(ID<OpaqVoxShadRenderComponent>(instance));
-	getGraphicsSystem()->destroy(component->vertexBuffer);
+	mesherSystem->freeMesh(component->allocation);
 	components.destroy(ID<OpaqVoxShadRenderComponent>(instance));
 }
 View<Component> OpaqVoxShadRenderSystem::getComponent(ID<Component> instance)
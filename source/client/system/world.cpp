@@ -30,7 +30,9 @@ void WorldSystem::initialize()
 	graphicsSystem = manager->get<GraphicsSystem>();
 	generatorSystem = manager->get<GeneratorSystem>(); 
 	mesherSystem = manager->get<MesherSystem>();
-	structure = Structure(manager, WORLD_STRUCTURE_ID, &freeChunks);
+	regionStorage = make_unique<RegionStorage>(fs::path("saves") / "world");
+	generatorSystem->setStorage(regionStorage.get());
+	structure = Structure(manager, WORLD_STRUCTURE_ID, &freeChunks, regionStorage.get());
 
 	auto camera = manager->createEntity();
 	auto transformComponent = manager->add<TransformComponent>(camera);
@@ -53,9 +55,154 @@ void WorldSystem::initialize()
 	// TODO: load mods voxels.
 	registry.finalize();
 }
+void WorldSystem::terminate()
+{
+	// Queued generation jobs are dropped, running ones are finished before storage is freed.
+	for (const auto& pair : structure.getChunks()) pair.second->jobs.cancel();
+	generatorSystem->setStorage(nullptr);
+	structure.saveChunks();
+	regionStorage.reset(); // Waits until all saved chunks are written.
+}
 
 static bool isCubeLoaded = false; // TODO: remove
 
+static const int3 sideOffsets[VOXEL_SIDE_COUNT] =
+{
+	int3(-1, 0, 0), int3(1, 0, 0),
+	int3(0, -1, 0), int3(0, 1, 0),
+	int3(0, 0, -1), int3(0, 0, 1),
+};
+
+// Seam sides border finer near chunks, their cracks are covered by this chunk faces.
+uint8 WorldSystem::getLodSeams(const int3& cameraPosition,
+	const int3& chunkPosition, uint8 lod) const noexcept
+{
+	if (lod == 0) return 0;
+	uint8 lodSeams = 0;
+	for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+	{
+		if (getChunkLOD(cameraPosition, chunkPosition + sideOffsets[side]) < lod)
+			lodSeams |= 1u << side;
+	}
+	return lodSeams;
+}
+
+//--------------------------------------------------------------------------------------------------
+// Resident chunks are palette packed, flat voxel storage is used by the in flight jobs.
+void WorldSystem::reserveViewChunks()
+{
+	auto radius = chunkViewRadius + 1.0f; // Near chunks of the cluster border.
+	structure.reserveChunks((psize)(4.19f * radius * radius * radius));
+	Chunk::getVoxelSlab().reserve((psize)maxPendingJobs * 3);
+	reservedViewRadius = chunkViewRadius;
+}
+
+//--------------------------------------------------------------------------------------------------
+void WorldSystem::remeshEditedChunks(std::function<void(MesherSystem::ChunkMesh&, uint32)> onMesh)
+{
+	auto& editedChunks = structure.getEditedChunks();
+	if (editedChunks.empty()) return;
+
+	// Near chunks are remeshed only if the edit touched their shared border.
+	remeshChunks.clear();
+	for (auto hash : editedChunks)
+	{
+		Chunk* chunk;
+		if (!structure.tryGetChunk(hash, chunk)) continue;
+		auto dirtySlices = chunk->dirtySlices;
+		chunk->dirtySlices = {};
+		chunk->isEmpty = false;
+		remeshChunks.push_back(hash);
+
+		for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+		{
+			if (dirtySlices.isSideDirty(side))
+				remeshChunks.push_back(posToChunkHash(chunk->position + sideOffsets[side]));
+		}
+	}
+	editedChunks.clear();
+
+	std::sort(remeshChunks.begin(), remeshChunks.end());
+	auto end = std::unique(remeshChunks.begin(), remeshChunks.end());
+
+	for (auto i = remeshChunks.begin(); i != end; i++)
+	{
+		Chunk* chunk;
+		if (!structure.tryGetChunk(*i, chunk) || (chunk->state != ChunkState::Meshing &&
+			chunk->state != ChunkState::Meshed)) continue;
+
+		if (chunk->isInactive)
+		{
+			// Edit changed the inactive neighbour border, it is remeshed after the re-entry.
+			chunk->state = ChunkState::Generated;
+			continue;
+		}
+
+		auto chunkPosition = chunk->position;
+		auto cluster = Cluster(chunk,
+			structure.getOrAddChunk(chunkPosition + sideOffsets[0]),
+			structure.getOrAddChunk(chunkPosition + sideOffsets[1]),
+			structure.getOrAddChunk(chunkPosition + sideOffsets[2]),
+			structure.getOrAddChunk(chunkPosition + sideOffsets[3]),
+			structure.getOrAddChunk(chunkPosition + sideOffsets[4]),
+			structure.getOrAddChunk(chunkPosition + sideOffsets[5]));
+
+		if (cluster.isMeshingReady())
+		{
+			// Pending background mesh is superseded by this one.
+			chunk->jobs.cancel();
+			chunk->state = ChunkState::Meshing;
+			mesherSystem->generateMeshNow(cluster, onMesh);
+		}
+		else
+		{
+			chunk->state = ChunkState::Generated;
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+// Chunks intersecting the view cone go first, then the nearest ones.
+uint64 WorldSystem::getJobPriority(const float3& cameraPosition,
+	const float3& viewDirection, const int3& chunkPosition) const noexcept
+{
+	constexpr auto chunkRadius = 0.8660254f; // sqrt(3) / 2, in chunks
+	auto direction = (float3)chunkPosition + 0.5f - cameraPosition;
+	auto distance = length(direction);
+	auto axisDistance = dot(direction, viewDirection);
+	auto radialDistance = std::sqrt(std::max(distance * distance - axisDistance * axisDistance, 0.0f));
+	auto isVisible = distance <= chunkRadius * 2.0f || radialDistance * std::cos(viewConeAngle) -
+		axisDistance * std::sin(viewConeAngle) <= chunkRadius;
+	return ((uint64)!isVisible << 32u) | (uint32)(distance * 256.0f);
+}
+
+// Only the best jobs are dispatched, others are collected and sorted again next frame.
+void WorldSystem::dispatchChunkJobs()
+{
+	auto jobCount = std::min((psize)(maxPendingJobs - std::min(
+		generatorSystem->getPendingCount(), maxPendingJobs)), generateJobs.size());
+	std::partial_sort(generateJobs.begin(), generateJobs.begin() + jobCount, generateJobs.end());
+	for (psize i = 0; i < jobCount; i++)
+	{
+		auto chunk = generateJobs[i].cluster.c;
+		generatorSystem->generateChunk(chunk->position,
+			WORLD_STRUCTURE_ID, GenType::DebugSphere, chunk->jobs.start());
+		chunk->state = ChunkState::Generating;
+	}
+	generateJobs.clear();
+
+	jobCount = std::min((psize)(maxPendingJobs - std::min(
+		mesherSystem->getPendingCount(), maxPendingJobs)), meshJobs.size());
+	std::partial_sort(meshJobs.begin(), meshJobs.begin() + jobCount, meshJobs.end());
+	for (psize i = 0; i < jobCount; i++)
+	{
+		auto& cluster = meshJobs[i].cluster;
+		mesherSystem->generateMesh(cluster, cluster.c->jobs.start());
+		cluster.c->state = ChunkState::Meshing;
+	}
+	meshJobs.clear();
+}
+
 //--------------------------------------------------------------------------------------------------
 void WorldSystem::update()
 {
@@ -75,44 +222,54 @@ void WorldSystem::update()
 		isCubeLoaded = true;
 	}
 
+	if (reservedViewRadius != chunkViewRadius) reserveViewChunks();
+
 	auto manager = getManager();
 	auto cameraTransform = manager->get<TransformComponent>(graphicsSystem->camera);
 	auto cameraPosition = clamp(worldToChunkPos(
 		cameraTransform->position), int3(minBorder), int3(maxBorder));
-	structure.removeOutOfView(cameraPosition, chunkViewRadius + 1);
+	structure.removeOutOfView(cameraPosition, chunkViewRadius + 1, inactiveChunkBudget);
 
-	generatorSystem->flush([this](const Chunk* genChunk)
+	generatorSystem->flush([this](Chunk* genChunk)
 	{
 		Chunk* worldChunk;
 		if (!structure.tryGetChunk(genChunk->position, worldChunk) ||
 			worldChunk->state != ChunkState::Generating) return;
-		if (genChunk->isEmpty) worldChunk->state = ChunkState::Meshed;
-		else
-		{
-			worldChunk->copy(genChunk->getVoxels());
-			worldChunk->state = ChunkState::Generated;
-		}
-		worldChunk->isEmpty = genChunk->isEmpty;
+		worldChunk->swapVoxels(*genChunk); // O(1) handoff, generated storage is not copied.
+		worldChunk->isUnsaved = genChunk->isUnsaved;
+		worldChunk->isEmpty = genChunk->isEmpty || (worldChunk->isUniform() &&
+			registry.isTransparent(worldChunk->getUniformVoxel()));
+		worldChunk->state = worldChunk->isEmpty ? ChunkState::Meshed : ChunkState::Generated;
 	});
 
 	graphicsSystem->startRecording(CommandBufferType::TransferOnly);
-	mesherSystem->flush([this](MesherSystem::ChunkMesh& chunkMesh, uint32 indexCount)
+	auto onMesh = [this](MesherSystem::ChunkMesh& chunkMesh, uint32 indexCount)
 	{
 		Chunk* worldChunk;
 		if (!structure.tryGetChunk(chunkMesh.position, worldChunk) ||
 			worldChunk->state != ChunkState::Meshing) return;
-		if (chunkMesh.vertexBuffer.getBinarySize() > 0)
+		auto opaqVoxComponent = getManager()->get<
+			OpaqVoxRenderComponent>(worldChunk->getEntity());
+		mesherSystem->freeMesh(opaqVoxComponent->allocation);
+		opaqVoxComponent->isEnabled = false;
+		if (chunkMesh.byteSize > 0)
 		{
-			auto opaqVoxComponent = getManager()->get<
-				OpaqVoxRenderComponent>(worldChunk->getEntity());
 			opaqVoxComponent->isEnabled = true;
-			opaqVoxComponent->vertexBuffer = mesherSystem->getVertexBuffer(chunkMesh);
+			opaqVoxComponent->allocation = mesherSystem->allocateMesh(chunkMesh);
 			opaqVoxComponent->indexCount = indexCount;
+			opaqVoxComponent->chunkPosition = chunkMesh.position;
+			for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+				opaqVoxComponent->sideQuadCounts[side] = chunkMesh.sideQuadCounts[side];
 		}
 		worldChunk->state = ChunkState::Meshed;
-	});
+	};
+	mesherSystem->flush(onMesh);
+	remeshEditedChunks(onMesh);
 	graphicsSystem->stopRecording();
 
+	// Priorities are recomputed every frame, so turning camera reorders pending jobs.
+	auto cameraChunkPosition = cameraTransform->position / CHUNK_LENGTH;
+	auto viewDirection = cameraTransform->rotation * float3::front;
 	auto chunkViewRadius2 = (int32)(chunkViewRadius * chunkViewRadius);
 	for (int16 z = 0; z <= chunkViewRadius;)
 	{
@@ -129,14 +286,27 @@ void WorldSystem::update()
 				}
 
 				auto chunk = structure.getOrAddChunk(chunkPosition);
+				auto lod = getChunkLOD(cameraPosition, chunkPosition);
+				auto lodSeams = getLodSeams(cameraPosition, chunkPosition, lod);
+
 				if (chunk->state == ChunkState::Allocated)
 				{
-					generatorSystem->generateChunk(chunkPosition,
-						WORLD_STRUCTURE_ID, GenType::DebugSphere);
-					chunk->state = ChunkState::Generating;
+					ChunkJob job;
+					job.priority = getJobPriority(cameraChunkPosition, viewDirection, chunkPosition);
+					job.cluster.c = chunk;
+					generateJobs.push_back(job);
 				}
-				else if (chunk->state == ChunkState::Generated)
+				else if (chunk->state == ChunkState::Meshed && !chunk->isEmpty &&
+					(chunk->lod != lod || chunk->lodSeams != lodSeams))
 				{
+					// Camera moved across the LOD ring, old mesh is shown until remeshed.
+					chunk->state = ChunkState::Generated;
+				}
+
+				if (chunk->state == ChunkState::Generated)
+				{
+					chunk->lod = lod;
+					chunk->lodSeams = lodSeams;
 					auto cluster = Cluster(chunk,
 						structure.getOrAddChunk(chunkPosition + int3(-1,  0,  0)),
 						structure.getOrAddChunk(chunkPosition + int3( 1,  0,  0)), 
@@ -147,8 +317,17 @@ void WorldSystem::update()
 
 					if (cluster.isMeshingReady())
 					{
-						mesherSystem->generateMesh(cluster);
-						chunk->state = ChunkState::Meshing;
+						if (cluster.isHidden(registry))
+						{
+							chunk->state = ChunkState::Meshed;
+						}
+						else
+						{
+							ChunkJob job;
+							job.priority = getJobPriority(cameraChunkPosition, viewDirection, chunkPosition);
+							job.cluster = cluster;
+							meshJobs.push_back(job);
+						}
 					}
 				}
 
@@ -163,4 +342,6 @@ void WorldSystem::update()
 		if (z > 0) z = -z;
 		else z = -z + 1;
 	}
+
+	dispatchChunkJobs();
 }
\ No newline at end of file
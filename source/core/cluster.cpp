@@ -0,0 +1,362 @@
+//--------------------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//--------------------------------------------------------------------------------------------------
+
+#include "voxfield/cluster.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace voxfield;
+
+namespace
+{
+	// Rows are [z][y] of x bits, opacity rows are padded by the near chunk border voxels.
+	struct OpacityMasks final
+	{
+		uint32 drawn[CHUNK_LENGTH][CHUNK_LENGTH];
+		uint32 opaque[CHUNK_LENGTH + 2][CHUNK_LENGTH + 2];
+		uint32 borderNX[CHUNK_LENGTH][CHUNK_LENGTH];
+		uint32 borderPX[CHUNK_LENGTH][CHUNK_LENGTH];
+		bool hasTranslucent;
+	};
+};
+
+//--------------------------------------------------------------------------------------------------
+static void getOpacityMasks(const SliceCluster& cluster,
+	const Registry& registry, OpacityMasks& masks) noexcept
+{
+	auto voxels = cluster.c.getVoxels();
+	if (voxels)
+	{
+		masks.hasTranslucent = false;
+		for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+		{
+			for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+			{
+				Voxel rowVoxels[CHUNK_LENGTH];
+				auto row = Chunk::getRow(voxels, y, z, rowVoxels);
+				auto firstVoxel = row[0];
+				uint32 difference = 0;
+				for (uint32 x = 1; x < CHUNK_LENGTH; x++)
+					difference |= row[x] ^ firstVoxel;
+
+				uint32 drawn = 0, opaque = 0;
+				if (difference == 0)
+				{
+					drawn = registry.isTransparent(firstVoxel) ? 0 : UINT32_MAX;
+					opaque = registry.isOpaque(firstVoxel) ? UINT32_MAX : 0;
+				}
+				else
+				{
+					for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+					{
+						auto voxel = row[x];
+						drawn |= (uint32)!registry.isTransparent(voxel) << x;
+						opaque |= (uint32)registry.isOpaque(voxel) << x;
+					}
+				}
+
+				masks.drawn[z][y] = drawn;
+				masks.opaque[z + 1][y + 1] = opaque;
+				masks.hasTranslucent |= (drawn & ~opaque) != 0;
+			}
+		}
+	}
+	else
+	{
+		// Uniform chunk, only border voxels can have visible faces.
+		auto voxel = cluster.c.getUniformVoxel();
+		auto drawn = registry.isTransparent(voxel) ? 0 : UINT32_MAX;
+		auto opaque = registry.isOpaque(voxel) ? UINT32_MAX : 0;
+		masks.hasTranslucent = (drawn & ~opaque) != 0;
+
+		for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+		{
+			for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+			{
+				masks.drawn[z][y] = drawn;
+				masks.opaque[z + 1][y + 1] = opaque;
+			}
+		}
+	}
+
+	for (uint8 i = 0; i < CHUNK_LENGTH; i++)
+	{
+		uint32 ny = 0, py = 0, nz = 0, pz = 0;
+		for (uint8 j = 0; j < CHUNK_LENGTH; j++)
+		{
+			ny |= (uint32)registry.isOpaque(cluster.ny[i][j]) << j;
+			py |= (uint32)registry.isOpaque(cluster.py[i][j]) << j;
+			nz |= (uint32)registry.isOpaque(cluster.nz[i][j]) << j;
+			pz |= (uint32)registry.isOpaque(cluster.pz[i][j]) << j;
+			masks.borderNX[i][j] = (uint32)registry.isOpaque(cluster.nx[i][j]);
+			masks.borderPX[i][j] = (uint32)registry.isOpaque(cluster.px[i][j]) << (CHUNK_LENGTH - 1);
+		}
+
+		masks.opaque[i + 1][0] = ny;
+		masks.opaque[i + 1][CHUNK_LENGTH + 1] = py;
+		masks.opaque[0][i + 1] = nz;
+		masks.opaque[CHUNK_LENGTH + 1][i + 1] = pz;
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+static void getNaturalFaceMasks(const OpacityMasks& masks, FaceMasks& faceMasks) noexcept
+{
+	auto& sides = faceMasks.sides;
+
+	#if defined(__AVX2__)
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y += 8)
+		{
+			auto drawn = _mm256_loadu_si256((const __m256i*)&masks.drawn[z][y]);
+			auto opaque = _mm256_loadu_si256((const __m256i*)&masks.opaque[z + 1][y + 1]);
+			auto borderNX = _mm256_loadu_si256((const __m256i*)&masks.borderNX[z][y]);
+			auto borderPX = _mm256_loadu_si256((const __m256i*)&masks.borderPX[z][y]);
+			auto nearNX = _mm256_or_si256(_mm256_slli_epi32(opaque, 1), borderNX);
+			auto nearPX = _mm256_or_si256(_mm256_srli_epi32(opaque, 1), borderPX);
+			auto nearNY = _mm256_loadu_si256((const __m256i*)&masks.opaque[z + 1][y]);
+			auto nearPY = _mm256_loadu_si256((const __m256i*)&masks.opaque[z + 1][y + 2]);
+			auto nearNZ = _mm256_loadu_si256((const __m256i*)&masks.opaque[z][y + 1]);
+			auto nearPZ = _mm256_loadu_si256((const __m256i*)&masks.opaque[z + 2][y + 1]);
+			_mm256_storeu_si256((__m256i*)&sides[0][z][y], _mm256_andnot_si256(nearNX, drawn));
+			_mm256_storeu_si256((__m256i*)&sides[1][z][y], _mm256_andnot_si256(nearPX, drawn));
+			_mm256_storeu_si256((__m256i*)&sides[2][z][y], _mm256_andnot_si256(nearNY, drawn));
+			_mm256_storeu_si256((__m256i*)&sides[3][z][y], _mm256_andnot_si256(nearPY, drawn));
+			_mm256_storeu_si256((__m256i*)&sides[4][z][y], _mm256_andnot_si256(nearNZ, drawn));
+			_mm256_storeu_si256((__m256i*)&sides[5][z][y], _mm256_andnot_si256(nearPZ, drawn));
+		}
+	}
+	#else
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			auto drawn = masks.drawn[z][y];
+			auto opaque = masks.opaque[z + 1][y + 1];
+			sides[0][z][y] = drawn & ~((opaque << 1u) | masks.borderNX[z][y]);
+			sides[1][z][y] = drawn & ~((opaque >> 1u) | masks.borderPX[z][y]);
+			sides[2][z][y] = drawn & ~masks.opaque[z + 1][y];
+			sides[3][z][y] = drawn & ~masks.opaque[z + 1][y + 2];
+			sides[4][z][y] = drawn & ~masks.opaque[z][y + 1];
+			sides[5][z][y] = drawn & ~masks.opaque[z + 2][y + 1];
+		}
+	}
+	#endif
+}
+
+//--------------------------------------------------------------------------------------------------
+// Hollow translucent voxels do not draw faces between each other.
+static void cullHollowFaces(const SliceCluster& cluster, const Registry& registry,
+	const OpacityMasks& masks, FaceMasks& faceMasks) noexcept
+{
+	static const int8 sideOffsets[VOXEL_SIDE_COUNT][3] =
+	{
+		{ -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }
+	};
+
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			auto translucent = masks.drawn[z][y] & ~masks.opaque[z + 1][y + 1];
+			if (!translucent) continue;
+
+			for (uint8 x = 0; x < CHUNK_LENGTH; x++)
+			{
+				if (!((translucent >> x) & 1u)) continue;
+				auto voxel = cluster.c.get(x, y, z);
+				if (!registry.isHollow(voxel)) continue;
+
+				for (uint8 side = 0; side < VOXEL_SIDE_COUNT; side++)
+				{
+					auto offset = sideOffsets[side];
+					auto nearVoxel = cluster.getNearVoxel(x + offset[0], y + offset[1], z + offset[2]);
+					if (!registry.shouldDrawFace(voxel, nearVoxel))
+						faceMasks.sides[side][z][y] &= ~(1u << x);
+				}
+			}
+		}
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+static void transposeBits32(uint32* rows) noexcept
+{
+	uint32 mask = 0x0000FFFFu;
+	for (uint32 j = 16; j != 0; j >>= 1u, mask ^= (mask << j))
+	{
+		for (uint32 k = 0; k < 32; k = (k + j + 1) & ~j)
+		{
+			auto t = ((rows[k] >> j) ^ rows[k + j]) & mask;
+			rows[k] ^= t << j; rows[k + j] ^= t;
+		}
+	}
+}
+static void transposeWords32(uint32 (*rows)[CHUNK_LENGTH]) noexcept
+{
+	for (uint8 i = 0; i < CHUNK_LENGTH; i++)
+	{
+		for (uint8 j = i + 1; j < CHUNK_LENGTH; j++)
+			std::swap(rows[i][j], rows[j][i]);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+static void getOcclusionMasks(const OpacityMasks& masks, OcclusionMasks& occlusionMasks) noexcept
+{
+	auto& rows = occlusionMasks.rows;
+	for (uint8 z = 0; z < CHUNK_LENGTH + 2; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH + 2; y++)
+			rows[z][y] = (uint64)masks.opaque[z][y] << 1u;
+	}
+	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			rows[z + 1][y + 1] |= masks.borderNX[z][y] |
+				((uint64)(masks.borderPX[z][y] >> (CHUNK_LENGTH - 1)) << (CHUNK_LENGTH + 1));
+		}
+	}
+
+	// Padding corners are not written by the opacity masks.
+	rows[0][0] = rows[0][CHUNK_LENGTH + 1] = 0;
+	rows[CHUNK_LENGTH + 1][0] = rows[CHUNK_LENGTH + 1][CHUNK_LENGTH + 1] = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+void SliceCluster::getFaceMasks(const Registry& registry,
+	FaceMasks& faceMasks, OcclusionMasks* occlusionMasks) const noexcept
+{
+	OpacityMasks masks;
+	getOpacityMasks(*this, registry, masks);
+	getNaturalFaceMasks(masks, faceMasks);
+	if (masks.hasTranslucent) cullHollowFaces(*this, registry, masks, faceMasks);
+	if (occlusionMasks) getOcclusionMasks(masks, *occlusionMasks);
+
+	// Natural rows are [z][y] of x bits, converting to the face masks layout.
+	uint32 column[CHUNK_LENGTH];
+	for (uint8 side = 0; side < 2; side++)
+	{
+		auto& rows = faceMasks.sides[side];
+		for (uint8 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			for (uint8 z = 0; z < CHUNK_LENGTH; z++) column[z] = rows[z][y];
+			transposeBits32(column);
+			for (uint8 x = 0; x < CHUNK_LENGTH; x++) rows[x][y] = column[x];
+		}
+	}
+
+	transposeWords32(faceMasks.sides[2]);
+	transposeWords32(faceMasks.sides[3]);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Returns top most not transparent block voxel, so that surface voxels stay visible.
+static Voxel getBlockVoxel(const Chunk* chunk, const Registry& registry,
+	int32 x, int32 y, int32 z, int32 blockLength) noexcept
+{
+	if (chunk->isUniform()) return chunk->getUniformVoxel();
+
+	for (int32 by = y + blockLength - 1; by >= y; by--)
+	{
+		for (int32 bz = z; bz < z + blockLength; bz++)
+		{
+			for (int32 bx = x; bx < x + blockLength; bx++)
+			{
+				auto voxel = chunk->get(bx, by, bz);
+				if (!registry.isTransparent(voxel)) return voxel;
+			}
+		}
+	}
+	return NULL_VOXEL;
+}
+// Fills near chunk border slice with the blocks adjacent to the center chunk side.
+static void downsampleSlice(const Chunk* chunk, const Registry& registry, uint8 side,
+	int32 blockLength, bool isSeam, Voxel slice[CHUNK_LENGTH][CHUNK_LENGTH]) noexcept
+{
+	auto border = side & 1u ? 0 : CHUNK_LENGTH - blockLength;
+	for (int32 i = 0; i < CHUNK_LENGTH; i += blockLength)
+	{
+		for (int32 j = 0; j < CHUNK_LENGTH; j += blockLength)
+		{
+			auto voxel = NULL_VOXEL;
+			if (!isSeam)
+			{
+				switch (side >> 1u)
+				{
+				case 0: voxel = getBlockVoxel(chunk, registry, border, j, i, blockLength); break;
+				case 1: voxel = getBlockVoxel(chunk, registry, j, border, i, blockLength); break;
+				default: voxel = getBlockVoxel(chunk, registry, j, i, border, blockLength); break;
+				}
+			}
+
+			for (int32 bi = i; bi < i + blockLength; bi++)
+			{
+				for (int32 bj = j; bj < j + blockLength; bj++) slice[bi][bj] = voxel;
+			}
+		}
+	}
+}
+
+void SliceCluster::downsample(const Cluster& cluster,
+	const Registry& registry, uint8 lod, uint8 seamSides)
+{
+	GARDEN_ASSERT(lod > 0 && lod < CHUNK_LOD_COUNT);
+	auto blockLength = 1 << lod;
+
+	if (!c.isUniform())
+	{
+		auto voxels = c.getVoxels();
+		for (int32 z = 0; z < CHUNK_LENGTH; z += blockLength)
+		{
+			for (int32 y = 0; y < CHUNK_LENGTH; y += blockLength)
+			{
+				for (int32 x = 0; x < CHUNK_LENGTH; x += blockLength)
+				{
+					auto voxel = getBlockVoxel(cluster.c, registry, x, y, z, blockLength);
+					#if defined(VOXFIELD_CHUNK_MORTON)
+					// Aligned power of two block is contiguous in the Z-order.
+					auto block = voxels + Chunk::posToIndex(x, y, z);
+					std::fill(block, block + blockLength * blockLength * blockLength, voxel);
+					#else
+					for (int32 bz = z; bz < z + blockLength; bz++)
+					{
+						for (int32 by = y; by < y + blockLength; by++)
+						{
+							auto row = voxels + Chunk::posToIndex(x, by, bz);
+							std::fill(row, row + blockLength, voxel);
+						}
+					}
+					#endif
+				}
+			}
+		}
+		c.tryMakeUniform();
+	}
+
+	downsampleSlice(cluster.nx, registry, 0, blockLength, seamSides & 1u, nx);
+	downsampleSlice(cluster.px, registry, 1, blockLength, seamSides & 2u, px);
+	downsampleSlice(cluster.ny, registry, 2, blockLength, seamSides & 4u, ny);
+	downsampleSlice(cluster.py, registry, 3, blockLength, seamSides & 8u, py);
+	downsampleSlice(cluster.nz, registry, 4, blockLength, seamSides & 16u, nz);
+	downsampleSlice(cluster.pz, registry, 5, blockLength, seamSides & 32u, pz);
+}
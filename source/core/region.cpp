@@ -0,0 +1,469 @@
+//--------------------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//--------------------------------------------------------------------------------------------------
+
+#include "voxfield/region.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace voxfield;
+
+static constexpr psize regionHeaderSize = sizeof(uint32) * 2 + sizeof(RegionStorage::Entry) * REGION_SIZE;
+static constexpr psize voxelRunSize = sizeof(Voxel) + sizeof(uint16);
+
+//--------------------------------------------------------------------------------------------------
+static uint64 getPositionKey(const int3& position) noexcept
+{
+	return ((uint64)((uint32)position.x & 0x1FFFFFu)) |
+		((uint64)((uint32)position.y & 0x1FFFFFu) << 21u) |
+		((uint64)((uint32)position.z & 0x1FFFFFu) << 42u);
+}
+// Arithmetic shift rounds negative chunk positions down to their region.
+static int3 getRegionPosition(const int3& chunkPosition) noexcept
+{
+	return int3(chunkPosition.x >> 3, chunkPosition.y >> 3, chunkPosition.z >> 3);
+}
+static uint32 getRegionIndex(const int3& chunkPosition) noexcept
+{
+	auto x = (uint32)chunkPosition.x & (REGION_LENGTH - 1);
+	auto y = (uint32)chunkPosition.y & (REGION_LENGTH - 1);
+	auto z = (uint32)chunkPosition.z & (REGION_LENGTH - 1);
+	return (z * REGION_LENGTH + y) * REGION_LENGTH + x;
+}
+static string getRegionName(const int3& regionPosition)
+{
+	return "r." + to_string(regionPosition.x) + "." + to_string(regionPosition.y) +
+		"." + to_string(regionPosition.z) + ".vxr";
+}
+
+// Region files grow by appending, so offsets can exceed the 32 bit long on Windows.
+static bool seekFile(FILE* file, uint64 offset, int origin = SEEK_SET) noexcept
+{
+	#if defined(_WIN32)
+	return _fseeki64(file, (__int64)offset, origin) == 0;
+	#else
+	return fseeko(file, (off_t)offset, origin) == 0;
+	#endif
+}
+static int64 tellFile(FILE* file) noexcept
+{
+	#if defined(_WIN32)
+	return _ftelli64(file);
+	#else
+	return ftello(file);
+	#endif
+}
+
+static const uint8* mapFile(FILE* file, psize size) noexcept
+{
+	#if defined(_WIN32)
+	auto fileHandle = (HANDLE)_get_osfhandle(_fileno(file));
+	auto mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle) return nullptr;
+	auto mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, size);
+	CloseHandle(mappingHandle); // View keeps mapping alive.
+	return (const uint8*)mapping;
+	#else
+	auto mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(file), 0);
+	return mapping == MAP_FAILED ? nullptr : (const uint8*)mapping;
+	#endif
+}
+static void unmapFile(const uint8* mapping, psize size) noexcept
+{
+	#if defined(_WIN32)
+	UnmapViewOfFile(mapping);
+	#else
+	munmap((void*)mapping, size);
+	#endif
+}
+static void closeRegionFile(FILE* file, const uint8* mapping, psize mappingSize) noexcept
+{
+	if (mapping) unmapFile(mapping, mappingSize);
+	if (file) fclose(file);
+}
+
+//--------------------------------------------------------------------------------------------------
+RegionStorage::RegionStorage(const fs::path& directory, uint32 maxOpenRegions) :
+	directory(directory), maxOpenRegions(maxOpenRegions)
+{
+	GARDEN_ASSERT(maxOpenRegions > 0);
+	fs::create_directories(directory);
+	writer = thread(&RegionStorage::runWriter, this);
+}
+RegionStorage::~RegionStorage()
+{
+	saveMutex.lock();
+	isRunning = false;
+	saveMutex.unlock();
+	saveCondition.notify_one();
+	writer.join();
+
+	for (const auto& pair : regions)
+	{
+		auto region = pair.second.get();
+		closeRegionFile(region->file, region->mapping, region->mappingSize);
+	}
+}
+
+// Opens existing region file and reads its index, corrupted file is recreated on save.
+// Returned region is not closed until it is released.
+RegionStorage::Region* RegionStorage::acquireRegion(const int3& regionPosition)
+{
+	lock_guard<mutex> lock(regionMutex);
+	auto key = getPositionKey(regionPosition);
+	auto result = regions.find(key);
+	if (result != regions.end())
+	{
+		auto region = result->second.get();
+		region->lastUse = ++useTick;
+		region->useCount++;
+		return region;
+	}
+
+	closeIdleRegions(maxOpenRegions - 1);
+	auto region = new Region();
+	region->position = regionPosition;
+	region->lastUse = ++useTick;
+	region->useCount = 1;
+	regions.emplace(key, unique_ptr<Region>(region));
+
+	auto path = directory / getRegionName(regionPosition);
+	auto file = fopen(path.string().c_str(), "r+b");
+	if (!file) return region;
+
+	uint32 header[2] = {};
+	if (fread(header, sizeof(uint32), 2, file) != 2 || header[0] != REGION_MAGIC ||
+		header[1] != REGION_VERSION || fread(region->index,
+		sizeof(Entry), REGION_SIZE, file) != REGION_SIZE || !seekFile(file, 0, SEEK_END))
+	{
+		fclose(file);
+		for (auto& entry : region->index) entry = {};
+		return region;
+	}
+
+	auto fileSize = tellFile(file);
+	if (fileSize < 0)
+	{
+		fclose(file);
+		for (auto& entry : region->index) entry = {};
+		return region;
+	}
+
+	region->file = file;
+	region->fileSize = (psize)fileSize;
+	for (auto& entry : region->index)
+	{
+		if ((psize)entry.offset + entry.size > region->fileSize) entry = {};
+	}
+	return region;
+}
+void RegionStorage::releaseRegion(Region* region)
+{
+	lock_guard<mutex> lock(regionMutex);
+	GARDEN_ASSERT(region->useCount > 0);
+	region->useCount--;
+}
+
+// Closes least recently used regions not in use, their writes are already flushed.
+// Index is read again from the file when the region is opened next time.
+void RegionStorage::closeIdleRegions(psize maxCount)
+{
+	while (regions.size() > maxCount)
+	{
+		auto oldest = regions.end();
+		for (auto i = regions.begin(); i != regions.end(); i++)
+		{
+			if (i->second->useCount > 0) continue;
+			if (oldest == regions.end() || i->second->lastUse < oldest->second->lastUse) oldest = i;
+		}
+		if (oldest == regions.end()) return;
+
+		auto region = oldest->second.get();
+		closeRegionFile(region->file, region->mapping, region->mappingSize);
+		regions.erase(oldest);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+bool RegionStorage::tryLoad(const int3& position, Chunk& chunk)
+{
+	// Queued chunk is newer than the stored one.
+	saveMutex.lock();
+	auto key = getPositionKey(position);
+	auto result = pendingChunks.find(key);
+	auto isPending = result != pendingChunks.end();
+	if (!isPending)
+	{
+		result = writingChunks.find(key);
+		isPending = result != writingChunks.end();
+	}
+	if (isPending) chunk.copy(result->second);
+	saveMutex.unlock();
+	if (isPending) return true;
+
+	auto region = acquireRegion(getRegionPosition(position));
+	auto isLoaded = readChunk(region, position, chunk);
+	releaseRegion(region);
+	return isLoaded;
+}
+bool RegionStorage::readChunk(Region* region, const int3& position, Chunk& chunk)
+{
+	lock_guard<mutex> lock(region->regionMutex);
+	auto entry = region->index[getRegionIndex(position)];
+	if (entry.offset == 0) return false;
+
+	// Mapping is extended only when a payload appended after it is read.
+	if ((psize)entry.offset + entry.size > region->mappingSize)
+	{
+		if (region->mapping) unmapFile(region->mapping, region->mappingSize);
+		region->mapping = mapFile(region->file, region->fileSize);
+		region->mappingSize = region->mapping ? region->fileSize : 0;
+		if (!region->mapping) return false;
+	}
+
+	if (!decode(region->mapping + entry.offset, entry.size, chunk))
+	{
+		chunk.fill(NULL_VOXEL);
+		return false;
+	}
+
+	loadCount++;
+	readBytes += entry.size;
+	return true;
+}
+void RegionStorage::save(const Chunk& chunk)
+{
+	saveMutex.lock();
+	pendingChunks[getPositionKey(chunk.position)] = chunk;
+	saveMutex.unlock();
+	saveCondition.notify_one();
+}
+void RegionStorage::flush()
+{
+	unique_lock<mutex> lock(saveMutex);
+	flushCondition.wait(lock, [this]() { return pendingChunks.empty() && writingChunks.empty(); });
+}
+
+RegionStorage::Stats RegionStorage::getStats() const noexcept
+{
+	Stats stats;
+	stats.loadCount = loadCount;
+	stats.saveCount = saveCount;
+	stats.readBytes = readBytes;
+	stats.writtenBytes = writtenBytes;
+	return stats;
+}
+
+//--------------------------------------------------------------------------------------------------
+void RegionStorage::runWriter()
+{
+	unique_lock<mutex> lock(saveMutex);
+	while (true)
+	{
+		saveCondition.wait(lock, [this]() { return !pendingChunks.empty() || !isRunning; });
+		if (pendingChunks.empty()) break;
+
+		// Chunks saved while writing are collected into the next batch.
+		std::swap(pendingChunks, writingChunks);
+		lock.unlock();
+		writeChunks();
+		lock.lock();
+		writingChunks.clear();
+		flushCondition.notify_all();
+	}
+}
+
+// Chunks of the same region are appended together, with one flush per region.
+void RegionStorage::writeChunks()
+{
+	struct WriteChunk final
+	{
+		uint64 regionKey;
+		int3 regionPosition;
+		uint32 index;
+		const Chunk* chunk;
+		bool operator<(const WriteChunk& w) const noexcept { return regionKey < w.regionKey; }
+	};
+
+	vector<WriteChunk> writes;
+	writes.reserve(writingChunks.size());
+	for (const auto& pair : writingChunks)
+	{
+		WriteChunk write;
+		write.regionPosition = getRegionPosition(pair.second.position);
+		write.regionKey = getPositionKey(write.regionPosition);
+		write.index = getRegionIndex(pair.second.position);
+		write.chunk = &pair.second;
+		writes.push_back(write);
+	}
+	std::sort(writes.begin(), writes.end());
+
+	vector<pair<uint32, Entry>> entries;
+	for (psize i = 0; i < writes.size();)
+	{
+		auto region = acquireRegion(writes[i].regionPosition);
+		auto regionEnd = i + 1;
+		while (regionEnd < writes.size() && writes[regionEnd].regionKey == writes[i].regionKey)
+			regionEnd++;
+
+		if (!region->file)
+		{
+			auto path = directory / getRegionName(region->position);
+			auto file = fopen(path.string().c_str(), "w+b");
+			uint32 header[2] = { REGION_MAGIC, REGION_VERSION };
+			Entry index[REGION_SIZE] = {};
+			if (!file || fwrite(header, sizeof(uint32), 2, file) != 2 ||
+				fwrite(index, sizeof(Entry), REGION_SIZE, file) != REGION_SIZE)
+			{
+				if (file) fclose(file);
+				releaseRegion(region);
+				i = regionEnd; // Chunks are regenerated if they can not be stored.
+				continue;
+			}
+
+			lock_guard<mutex> lock(region->regionMutex);
+			region->file = file;
+			region->fileSize = regionHeaderSize;
+		}
+
+		// Only the writer appends, readers see entries after they are flushed and published.
+		region->regionMutex.lock();
+		auto writeOffset = region->fileSize;
+		region->regionMutex.unlock();
+
+		entries.clear();
+		auto file = region->file;
+		for (; i < regionEnd; i++)
+		{
+			encode(*writes[i].chunk, writePayload, writeVoxels);
+			// Index entry offsets are 32 bit, full region keeps the previously stored chunk.
+			if ((uint64)writeOffset + writePayload.size() > UINT32_MAX) continue;
+
+			Entry entry;
+			entry.offset = (uint32)writeOffset;
+			entry.size = (uint32)writePayload.size();
+
+			if (!seekFile(file, writeOffset) ||
+				fwrite(writePayload.data(), 1, writePayload.size(), file) != writePayload.size() ||
+				!seekFile(file, sizeof(uint32) * 2 + sizeof(Entry) * writes[i].index) ||
+				fwrite(&entry, sizeof(Entry), 1, file) != 1) continue;
+
+			entries.emplace_back(writes[i].index, entry);
+			writeOffset += writePayload.size();
+			writtenBytes += writePayload.size();
+			saveCount++;
+		}
+		fflush(file);
+
+		region->regionMutex.lock();
+		for (const auto& entry : entries) region->index[entry.first] = entry.second;
+		region->fileSize = writeOffset;
+		region->regionMutex.unlock();
+		releaseRegion(region);
+	}
+}
+
+//--------------------------------------------------------------------------------------------------
+void RegionStorage::encode(const Chunk& chunk, vector<uint8>& payload, vector<Voxel>& voxels)
+{
+	payload.clear();
+	auto appendRun = [&payload](Voxel voxel, uint16 length)
+	{
+		auto offset = payload.size();
+		payload.resize(offset + voxelRunSize);
+		memcpy(payload.data() + offset, &voxel, sizeof(Voxel));
+		memcpy(payload.data() + offset + sizeof(Voxel), &length, sizeof(uint16));
+	};
+
+	if (chunk.isUniform())
+	{
+		appendRun(chunk.getUniformVoxel(), CHUNK_SIZE);
+		return;
+	}
+
+	voxels.resize(CHUNK_SIZE);
+	chunk.decode(voxels.data());
+	auto runVoxel = voxels[Chunk::posToIndex(0, 0, 0)];
+	uint16 runLength = 0;
+
+	for (int32 z = 0; z < CHUNK_LENGTH; z++)
+	{
+		for (int32 y = 0; y < CHUNK_LENGTH; y++)
+		{
+			for (int32 x = 0; x < CHUNK_LENGTH; x++)
+			{
+				auto voxel = voxels[Chunk::posToIndex(x, y, z)];
+				if (voxel != runVoxel)
+				{
+					appendRun(runVoxel, runLength);
+					runVoxel = voxel;
+					runLength = 0;
+				}
+				runLength++;
+			}
+		}
+	}
+	appendRun(runVoxel, runLength);
+}
+bool RegionStorage::decode(const uint8* payload, psize size, Chunk& chunk)
+{
+	GARDEN_ASSERT(payload);
+	if (size == 0 || size % voxelRunSize != 0) return false;
+
+	Voxel voxel; uint16 length;
+	auto runCount = size / voxelRunSize;
+	if (runCount == 1)
+	{
+		memcpy(&voxel, payload, sizeof(Voxel));
+		memcpy(&length, payload + sizeof(Voxel), sizeof(uint16));
+		if (length != CHUNK_SIZE) return false;
+		chunk.fill(voxel);
+		return true;
+	}
+
+	chunk.fill(NULL_VOXEL);
+	auto voxels = chunk.getVoxels();
+	psize index = 0;
+
+	for (psize i = 0; i < runCount; i++, payload += voxelRunSize)
+	{
+		memcpy(&voxel, payload, sizeof(Voxel));
+		memcpy(&length, payload + sizeof(Voxel), sizeof(uint16));
+		if (length == 0 || index + length > CHUNK_SIZE) return false;
+
+		#if defined(VOXFIELD_CHUNK_MORTON)
+		for (auto end = index + length; index < end; index++)
+		{
+			voxels[Chunk::posToIndex((int32)(index % CHUNK_LENGTH), (int32)((index / CHUNK_LENGTH) %
+				CHUNK_LENGTH), (int32)(index / (CHUNK_LENGTH * CHUNK_LENGTH)))] = voxel;
+		}
+		#else
+		std::fill(voxels + index, voxels + index + length, voxel);
+		index += length;
+		#endif
+	}
+
+	if (index != CHUNK_SIZE) return false;
+	chunk.pack();
+	return true;
+}
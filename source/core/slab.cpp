@@ -0,0 +1,136 @@
+//--------------------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//--------------------------------------------------------------------------------------------------
+
+#include "voxfield/slab.hpp"
+#include <algorithm>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace voxfield;
+
+//--------------------------------------------------------------------------------------------------
+static uint8* allocateSlab(bool useHugePages, bool& isHuge) noexcept
+{
+	isHuge = false;
+	#if defined(_WIN32)
+	if (useHugePages && GetLargePageMinimum() == SLAB_SIZE)
+	{
+		// Requires SeLockMemoryPrivilege, falls back to the regular pages.
+		auto slab = VirtualAlloc(nullptr, SLAB_SIZE,
+			MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (slab) { isHuge = true; return (uint8*)slab; }
+	}
+	return (uint8*)VirtualAlloc(nullptr, SLAB_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	#else
+	#if defined(MAP_HUGETLB)
+	if (useHugePages)
+	{
+		// Explicit huge pages are only available if the system has reserved them.
+		auto slab = mmap(nullptr, SLAB_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (slab != MAP_FAILED) { isHuge = true; return (uint8*)slab; }
+	}
+	#endif
+
+	// Maps twice the size to align slab, so that transparent huge page can back it.
+	auto mapping = mmap(nullptr, SLAB_SIZE * 2, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) return nullptr;
+	auto address = (uintptr_t)mapping;
+	auto slab = (address + (SLAB_SIZE - 1)) & ~(uintptr_t)(SLAB_SIZE - 1);
+	if (slab > address) munmap(mapping, slab - address);
+	if (slab + SLAB_SIZE < address + SLAB_SIZE * 2)
+		munmap((void*)(slab + SLAB_SIZE), address + SLAB_SIZE * 2 - (slab + SLAB_SIZE));
+
+	#if defined(MADV_HUGEPAGE)
+	if (useHugePages) madvise((void*)slab, SLAB_SIZE, MADV_HUGEPAGE);
+	#endif
+	return (uint8*)slab;
+	#endif
+}
+static void freeSlab(uint8* slab) noexcept
+{
+	#if defined(_WIN32)
+	VirtualFree(slab, 0, MEM_RELEASE);
+	#else
+	munmap(slab, SLAB_SIZE);
+	#endif
+}
+
+//--------------------------------------------------------------------------------------------------
+SlabAllocator::SlabAllocator(psize blockSize, bool useHugePages)
+{
+	GARDEN_ASSERT(blockSize > 0 && blockSize <= SLAB_SIZE);
+	this->blockSize = blockSize;
+	this->blocksPerSlab = (uint32)(SLAB_SIZE / blockSize);
+	this->useHugePages = useHugePages;
+}
+SlabAllocator::~SlabAllocator()
+{
+	for (auto slab : slabs) freeSlab(slab);
+}
+
+void SlabAllocator::addSlab(bool prefault)
+{
+	// Free list capacity fits all blocks, so that free never allocates.
+	slabs.reserve(slabs.size() + 1);
+	freeBlocks.reserve(std::max((slabs.size() + 1) * blocksPerSlab, freeBlocks.capacity() * 2));
+
+	bool isHuge;
+	auto slab = allocateSlab(useHugePages, isHuge);
+	if (!slab) throw bad_alloc();
+	if (isHuge) hugeSlabCount++;
+	slabs.push_back(slab);
+
+	// Touches all slab pages, so that they are mapped now and not on the first chunk write.
+	if (prefault)
+	{
+		for (psize i = 0; i < SLAB_SIZE; i += 4096) slab[i] = 0;
+	}
+
+	// Reverse order, so that blocks are taken from the slab start.
+	for (int64 i = (int64)blocksPerSlab - 1; i >= 0; i--)
+		freeBlocks.push_back(slab + i * blockSize);
+}
+
+//--------------------------------------------------------------------------------------------------
+void* SlabAllocator::allocate()
+{
+	lock_guard<mutex> lock(blockMutex);
+	if (freeBlocks.empty()) addSlab(false);
+	auto block = freeBlocks.back();
+	freeBlocks.pop_back();
+	return block;
+}
+void SlabAllocator::free(void* block) noexcept
+{
+	if (!block) return;
+	lock_guard<mutex> lock(blockMutex);
+	GARDEN_ASSERT(freeBlocks.size() < freeBlocks.capacity());
+	freeBlocks.push_back((uint8*)block);
+}
+void SlabAllocator::reserve(psize count)
+{
+	lock_guard<mutex> lock(blockMutex);
+	while (freeBlocks.size() < count) addSlab(true);
+}
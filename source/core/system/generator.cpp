@@ -29,6 +29,7 @@ namespace
 		int3 position;
 		uint32 structureID;
 		GenType genType;
+		JobHandle job;
 	};
 };
 
@@ -54,27 +55,69 @@ void GeneratorSystem::terminate()
 	for (uint32 i = 0; i < noiseCount; i++)
 		delete (FastNoise::SmartNode<FastNoise::Simplex>*)noiseGens[i];
 	free(noiseGens);
+	for (auto chunk : freeChunks) delete chunk;
 }
 
 //----------------------------------------------------------------------------------------
 void GeneratorSystem::generate(const ThreadPool::Task& task)
 {
 	auto data = (ChunkData*)task.getArgument();
-	auto chunk = new Chunk(NULL_VOXEL, data->position, data->structureID, {});
+	auto system = data->system;
+
+	// Queued job of the evicted chunk is dropped without generating it.
+	if (data->job.isCancelled())
+	{
+		system->chunkMutex.lock();
+		system->cancelledCount++;
+		system->chunkMutex.unlock();
+		delete data;
+		return;
+	}
+
+	// Chunk objects are reused, their voxel storage is returned to the slab on flush.
+	Chunk* chunk = nullptr;
+	system->chunkMutex.lock();
+	if (!system->freeChunks.empty())
+	{
+		chunk = system->freeChunks.back();
+		system->freeChunks.pop_back();
+	}
+	system->chunkMutex.unlock();
+
+	if (chunk) *chunk = Chunk(NULL_VOXEL, data->position, data->structureID, {});
+	else chunk = new Chunk(NULL_VOXEL, data->position, data->structureID, {});
 	auto genType = data->genType;
 
-	switch (genType)
+	// Loading stored chunk is faster than generating it, and keeps voxel edits.
+	if (!system->storage || !system->storage->tryLoad(data->position, *chunk))
 	{
-	case GenType::DebugSoloVoxel:
-		chunk->isEmpty = !generateDebugSoloVoxel(data, chunk); break;
-	case GenType::DebugSphere:
-		chunk->isEmpty = !generateDebugSphere(data, chunk); break;
-	default: abort();
+		switch (genType)
+		{
+		case GenType::DebugSoloVoxel:
+			chunk->isEmpty = !generateDebugSoloVoxel(data, chunk); break;
+		case GenType::DebugSphere:
+			chunk->isEmpty = !generateDebugSphere(data, chunk); break;
+		default: abort();
+		}
+
+		// Untouched chunks are generated again instead of stored, only edits are saved.
+		chunk->pack();
 	}
 
-	auto system = data->system;
 	system->chunkMutex.lock();
-	system->chunks.push_back(chunk);
+	if (data->job.isCancelled())
+	{
+		system->cancelledCount++;
+		chunk->fill(NULL_VOXEL);
+		system->freeChunks.push_back(chunk);
+	}
+	else
+	{
+		GeneratedChunk generatedChunk;
+		generatedChunk.chunk = chunk;
+		generatedChunk.job = data->job;
+		system->chunks.push_back(generatedChunk);
+	}
 	system->chunkMutex.unlock();
 	delete data;
 }
@@ -90,7 +133,6 @@ bool GeneratorSystem::generateDebugSphere(const void* _data, Chunk* chunk)
 	auto voxels = chunk->getVoxels();
 	auto center = int3(CHUNK_HALF_LENGTH);
 	auto maxDist2 = (CHUNK_HALF_LENGTH / 2) * (CHUNK_HALF_LENGTH / 2);
-	psize index = 0;
 
 	for (uint8 z = 0; z < CHUNK_LENGTH; z++)
 	{
@@ -99,8 +141,7 @@ bool GeneratorSystem::generateDebugSphere(const void* _data, Chunk* chunk)
 			for (uint8 x = 0; x < CHUNK_LENGTH; x++)
 			{
 				if (distance2(int3(x, y, z), center) < maxDist2)
-					voxels[index] = DEBUG_VOXEL;
-				index++;
+					voxels[Chunk::posToIndex(x, y, z)] = DEBUG_VOXEL;
 			}
 		}
 	}
@@ -110,26 +151,51 @@ bool GeneratorSystem::generateDebugSphere(const void* _data, Chunk* chunk)
 
 //--------------------------------------------------------------------------------------------------
 void GeneratorSystem::generateChunk(const int3& position,
-	uint32 structureID, GenType genType)
+	uint32 structureID, GenType genType, const JobHandle& job)
 {
 	auto chunkData = new ChunkData();
 	chunkData->system = this;
 	chunkData->position = position;
 	chunkData->structureID = structureID;
 	chunkData->genType = genType;
+	chunkData->job = job;
 
 	auto& threadPool = threadSystem->getBackgroundPool();
 	threadPool.addTask(ThreadPool::Task(generate, chunkData));
+	pendingCount++;
+}
+void GeneratorSystem::setStorage(RegionStorage* storage)
+{
+	// Storage is read by the workers, tasks added later see the new value.
+	threadSystem->getBackgroundPool().wait();
+	this->storage = storage;
 }
-void GeneratorSystem::flush(std::function<void(const Chunk*)> onChunk)
+void GeneratorSystem::flush(std::function<void(Chunk*)> onChunk)
 {
 	GARDEN_ASSERT(onChunk);
+
+	// Only the chunk lists are swapped under lock, so workers are not blocked by callbacks.
 	chunkMutex.lock();
-	for (auto chunk : chunks)
+	std::swap(chunks, flushChunks);
+	auto cancelledCount = this->cancelledCount;
+	this->cancelledCount = 0;
+	chunkMutex.unlock();
+
+	GARDEN_ASSERT(pendingCount >= flushChunks.size() + cancelledCount);
+	pendingCount -= (uint32)flushChunks.size() + cancelledCount;
+	if (flushChunks.empty()) return;
+
+	// Job can be cancelled after the worker has finished, the chunk may be re-added since.
+	for (const auto& generatedChunk : flushChunks)
 	{
-		onChunk(chunk);
-		delete chunk;
+		auto chunk = generatedChunk.chunk;
+		if (!generatedChunk.job.isCancelled()) onChunk(chunk);
+		chunk->fill(NULL_VOXEL);
 	}
-	chunks.clear();
+
+	chunkMutex.lock();
+	for (const auto& generatedChunk : flushChunks)
+		freeChunks.push_back(generatedChunk.chunk);
 	chunkMutex.unlock();
+	flushChunks.clear();
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/client/allocator.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace voxfield::client;
+
+#define TEST_CHECK(condition) if (!(condition)) { \
+	printf("Failed: %s (%s:%d)\n", #condition, __FILE__, __LINE__); exit(EXIT_FAILURE); }
+
+static void testAllocateFree()
+{
+	OffsetAllocator allocator(1024);
+	auto a = allocator.allocate(100);
+	auto b = allocator.allocate(200);
+	TEST_CHECK(a.isValid() && b.isValid());
+	TEST_CHECK(a.offset == 0 && b.offset == 112); // Sizes are rounded up to the alignment.
+	TEST_CHECK(allocator.getAllocationSize(a) == 112);
+	TEST_CHECK(allocator.getAllocationCount() == 2);
+	TEST_CHECK(allocator.getFreeSize() == 1024 - 112 - 208);
+
+	allocator.free(a); allocator.free(b);
+	TEST_CHECK(allocator.getAllocationCount() == 0);
+	TEST_CHECK(allocator.getFreeSize() == 1024);
+
+	auto full = allocator.allocate(1024);
+	TEST_CHECK(full.isValid() && full.offset == 0);
+	TEST_CHECK(!allocator.allocate(16).isValid());
+	allocator.free(full);
+	TEST_CHECK(!allocator.allocate(1025).isValid());
+}
+
+static void testMerge()
+{
+	OffsetAllocator allocator(64 * 4);
+	OffsetAllocator::Allocation allocations[4];
+	for (auto& allocation : allocations)
+	{
+		allocation = allocator.allocate(64);
+		TEST_CHECK(allocation.isValid());
+	}
+
+	// Middle regions are merged with both free neighbors.
+	allocator.free(allocations[0]); allocator.free(allocations[2]);
+	TEST_CHECK(allocator.getStats().freeRegionCount == 2);
+	TEST_CHECK(!allocator.allocate(128).isValid());
+	allocator.free(allocations[1]);
+	auto stats = allocator.getStats();
+	TEST_CHECK(stats.freeRegionCount == 1 && stats.largestFreeRegion == 192);
+
+	auto merged = allocator.allocate(192);
+	TEST_CHECK(merged.isValid() && merged.offset == 0);
+	allocator.free(merged); allocator.free(allocations[3]);
+	stats = allocator.getStats();
+	TEST_CHECK(stats.freeRegionCount == 1 && stats.largestFreeRegion == 256);
+	TEST_CHECK(stats.getFragmentation() == 0.0f);
+}
+
+static void testFragmentation()
+{
+	const uint32 count = 256;
+	OffsetAllocator allocator(count * 64);
+	vector<OffsetAllocator::Allocation> allocations(count);
+	for (auto& allocation : allocations) allocation = allocator.allocate(64);
+
+	// Every other region is free, so no bigger allocation fits.
+	for (uint32 i = 0; i < count; i += 2) allocator.free(allocations[i]);
+	auto stats = allocator.getStats();
+	TEST_CHECK(stats.freeRegionCount == count / 2 && stats.largestFreeRegion == 64);
+	TEST_CHECK(stats.getFragmentation() > 0.9f);
+	TEST_CHECK(!allocator.allocate(128).isValid());
+	TEST_CHECK(allocator.allocate(64).isValid());
+}
+
+static void testRandom()
+{
+	const uint32 size = 1024 * 1024;
+	OffsetAllocator allocator(size);
+	vector<OffsetAllocator::Allocation> allocations;
+	mt19937 random(1);
+
+	for (uint32 i = 0; i < 100000; i++)
+	{
+		if (allocations.empty() || random() % 3 != 0)
+		{
+			auto allocation = allocator.allocate(random() % 4096 + 1);
+			if (allocation.isValid()) allocations.push_back(allocation);
+		}
+		else
+		{
+			auto index = random() % allocations.size();
+			allocator.free(allocations[index]);
+			allocations[index] = allocations.back();
+			allocations.pop_back();
+		}
+	}
+
+	// Allocated regions never overlap and stay inside the range.
+	sort(allocations.begin(), allocations.end(), [](const auto& a, const auto& b) { return a.offset < b.offset; });
+	uint64 usedSize = 0;
+	for (psize i = 0; i < allocations.size(); i++)
+	{
+		auto end = (uint64)allocations[i].offset + allocator.getAllocationSize(allocations[i]);
+		TEST_CHECK(end <= size);
+		TEST_CHECK(i + 1 == allocations.size() || end <= allocations[i + 1].offset);
+		usedSize += allocator.getAllocationSize(allocations[i]);
+	}
+	TEST_CHECK(usedSize + allocator.getFreeSize() == size);
+
+	for (auto allocation : allocations) allocator.free(allocation);
+	auto stats = allocator.getStats();
+	TEST_CHECK(stats.freeRegionCount == 1 && stats.freeSize == size);
+}
+
+int main(int argc, char *argv[])
+{
+	testAllocateFree();
+	testMerge();
+	testFragmentation();
+	testRandom();
+	return EXIT_SUCCESS;
+}
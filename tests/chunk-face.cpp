@@ -0,0 +1,117 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/client/system/mesher.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace voxfield::client;
+
+#define TEST_CHECK(condition) if (!(condition)) { \
+	printf("Failed: %s (%s:%d)\n", #condition, __FILE__, __LINE__); exit(EXIT_FAILURE); }
+
+// Face corner offset bits, copied from the opaq-vox-face vertex shader. (common/chunk.gsl)
+static const uint32 shaderCornersU[VOXEL_SIDE_COUNT] = { 3, 12, 12, 12, 12, 3 };
+static const uint32 shaderCornersV[VOXEL_SIDE_COUNT] = { 6, 6, 9, 6, 6, 6 };
+
+static void testRoundTrip(const ChunkQuad& quad)
+{
+	auto face = ChunkFace(quad);
+	auto result = face.getQuad();
+	TEST_CHECK(result.x == quad.x && result.y == quad.y && result.z == quad.z);
+	TEST_CHECK(result.side == quad.side);
+	TEST_CHECK(result.sizeU == quad.sizeU && result.sizeV == quad.sizeV);
+	TEST_CHECK(result.occlusion == quad.occlusion);
+	TEST_CHECK(result.voxel == NULL_VOXEL);
+}
+
+// Decodes faces the way the vertex shader does and compares them with the expanded vertices.
+static void testVertexCorners(const ChunkQuad& quad)
+{
+	ChunkVertex vertices[QUAD_VERTEX_COUNT];
+	MesherSystem::writeVertices(&quad, 1, vertices);
+	auto face = ChunkFace(quad);
+
+	auto normal = (face.x >> (CHUNK_FACE_POS_BITS * 3u)) & CHUNK_FACE_NORM_MASK;
+	auto sizeShift = CHUNK_FACE_POS_BITS * 3u + CHUNK_FACE_NORM_BITS;
+	auto sizeU = ((face.x >> sizeShift) & CHUNK_FACE_SIZE_MASK) + 1u;
+	auto sizeV = ((face.x >> (sizeShift + CHUNK_FACE_SIZE_BITS)) & CHUNK_FACE_SIZE_MASK) + 1u;
+	auto plane = normal & 1u;
+
+	for (uint32 corner = 0; corner < QUAD_VERTEX_COUNT; corner++)
+	{
+		auto cornerU = (shaderCornersU[normal] >> corner) & 1u;
+		auto cornerV = (shaderCornersV[normal] >> corner) & 1u;
+		auto u = cornerU * sizeU, v = cornerV * sizeV;
+
+		uint32 x = face.x & CHUNK_FACE_POS_MASK;
+		uint32 y = (face.x >> CHUNK_FACE_POS_BITS) & CHUNK_FACE_POS_MASK;
+		uint32 z = (face.x >> (CHUNK_FACE_POS_BITS * 2u)) & CHUNK_FACE_POS_MASK;
+		switch (normal >> 1u)
+		{
+		case 0: x += plane; y += v; z += u; break;
+		case 1: x += u; y += plane; z += v; break;
+		default: x += u; y += v; z += plane; break;
+		}
+		auto occlusion = (face.y >> ((cornerV * 2u + cornerU) * 2u)) & CHUNK_VERT_AO_MASK;
+
+		auto& vertex = vertices[corner];
+		TEST_CHECK((vertex.x & CHUNK_VERT_POS_MASK) == x * 511u);
+		TEST_CHECK(((vertex.x >> CHUNK_VERT_POS_BITS) & CHUNK_VERT_POS_MASK) == y * 511u);
+		TEST_CHECK((vertex.y & CHUNK_VERT_POS_MASK) == z * 511u);
+		TEST_CHECK(((vertex.x >> (CHUNK_VERT_POS_BITS * 2u)) & CHUNK_VERT_NORM_MASK) == normal);
+		TEST_CHECK((vertex.y >> (CHUNK_VERT_POS_BITS + CHUNK_VERT_UV_BITS * 2u)) == occlusion);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static_assert(sizeof(ChunkFace) == 8, "Chunk face should be 8 bytes");
+
+	ChunkQuad quad = {};
+	quad.sizeU = quad.sizeV = 1;
+	testRoundTrip(quad);
+	testVertexCorners(quad);
+
+	// Maximum field values shouldn't overlap with the neighbor fields.
+	quad.x = quad.y = quad.z = CHUNK_LENGTH - 1;
+	quad.side = VOXEL_SIDE_COUNT - 1;
+	quad.sizeU = quad.sizeV = CHUNK_LENGTH;
+	quad.voxel = 123;
+	quad.occlusion = CHUNK_FACE_AO_MASK;
+	testRoundTrip(quad);
+
+	for (uint32 i = 0; i < 4096; i++)
+	{
+		quad.x = i % CHUNK_LENGTH;
+		quad.y = (i * 7u) % CHUNK_LENGTH;
+		quad.z = (i * 13u) % CHUNK_LENGTH;
+		quad.side = i % VOXEL_SIDE_COUNT;
+		quad.sizeU = (i * 3u) % CHUNK_LENGTH + 1u;
+		quad.sizeV = (i * 5u) % CHUNK_LENGTH + 1u;
+		quad.occlusion = (uint8)(i * 37u);
+		testRoundTrip(quad);
+
+		// Mesher quads never cross the chunk bounds.
+		quad.x %= CHUNK_LENGTH / 2; quad.y %= CHUNK_LENGTH / 2; quad.z %= CHUNK_LENGTH / 2;
+		quad.sizeU = quad.sizeU % (CHUNK_LENGTH / 2) + 1u;
+		quad.sizeV = quad.sizeV % (CHUNK_LENGTH / 2) + 1u;
+		testVertexCorners(quad);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+//----------------------------------------------------------------------------------------
+// Voxfield - An open source voxel based multiplayer sandbox game.
+// Copyright (C) 2022-2024  Nikita Fediuchin
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//----------------------------------------------------------------------------------------
+
+#include "voxfield/client/staging.hpp"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace voxfield::client;
+
+#define TEST_CHECK(condition) if (!(condition)) { \
+	printf("Failed: %s (%s:%d)\n", #condition, __FILE__, __LINE__); exit(EXIT_FAILURE); }
+
+static void testWrap()
+{
+	StagingRing ring(256, 1, 1);
+	auto a = ring.allocate(96);
+	auto b = ring.allocate(96);
+	TEST_CHECK(a == 0 && b == 96);
+	TEST_CHECK(ring.allocate(96) == StagingRing::invalidOffset);
+
+	// Released memory is reused from the ring beginning, end remainder is skipped.
+	ring.beginFrame(); ring.endFrame();
+	auto c = ring.allocate(96);
+	TEST_CHECK(c == 0);
+	TEST_CHECK(ring.getUsedSize() == 256 + 96 - 192);
+	TEST_CHECK(ring.allocate(257) == StagingRing::invalidOffset);
+}
+
+static void testFrameFence()
+{
+	const uint32 frameCount = 3;
+	StagingRing ring(256, frameCount, 1);
+	TEST_CHECK(ring.allocate(256) == 0);
+
+	// Memory is released only after frameCount frames.
+	for (uint32 i = 0; i < frameCount - 1; i++)
+	{
+		ring.beginFrame(); ring.endFrame();
+		TEST_CHECK(ring.allocate(16) == StagingRing::invalidOffset);
+	}
+	ring.beginFrame(); ring.endFrame();
+	TEST_CHECK(ring.allocate(16) == 0);
+}
+
+static void testWriters()
+{
+	StagingRing ring(256, 1, 2);
+	ring.beginWrite(0);
+	TEST_CHECK(ring.allocate(64) == 0);
+
+	// Memory of the unfinished write is not released, later writes are kept too.
+	ring.beginWrite(1);
+	TEST_CHECK(ring.allocate(64) == 64);
+	ring.endWrite(1);
+	ring.beginFrame(); ring.endFrame();
+	TEST_CHECK(ring.getUsedSize() == 128);
+
+	// Fence advances while other writers are still active.
+	ring.endWrite(0);
+	ring.beginWrite(1);
+	ring.beginFrame(); ring.endFrame();
+	TEST_CHECK(ring.getUsedSize() == 0);
+	ring.endWrite(1);
+}
+
+int main(int argc, char *argv[])
+{
+	testWrap();
+	testFrameFence();
+	testWriters();
+	return EXIT_SUCCESS;
+}